@@ -0,0 +1,446 @@
+// Replays recorded challenge messages against the solvers, without going near
+// the server, and prints attempts/sec, time to solution, challenge switch
+// latency and scaling over a sweep of thread counts as JSON.
+//
+//   make bench
+//   ./MinerBench [--seconds S] [--attempts N] [--threads 1,2,4] [--generic]
+//                [--kernel KERNEL=VARIANT]... [--pin]
+//                [--huge-pages off|transparent|explicit] [--trace FILE]
+//                FILE...
+//
+// Every FILE holds one challenge message per line, exactly as the server
+// sends them; lines without a challenge_name are skipped.  A cell (challenge,
+// thread count) runs back to back rounds like the miner does: every worker
+// switches to the challenge, and the round ends at the first solution.  A cell
+// ends after S seconds (default 5) or N attempts, whichever comes first.
+//
+// An attempt is one candidate solution checked against the prefix, so
+// shortest_path grids without a path aren't counted.
+//
+// --generic skips the solvers specialized for fixed list lengths and grid
+// sizes (see solver_registry.h), to compare against them.
+//
+// --kernel skips timing KERNEL at startup and uses VARIANT (see autotune.h),
+// to compare the variants against each other.
+//
+// --pin pins the workers to one physical core each, and --huge-pages sets
+// how big buffers are backed (see huge_pages.h), as they do for the miner.
+//
+// --trace writes a timeline of the whole run to FILE (see trace.h).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "autotune.h"
+#include "cancellation_token.h"
+#include "challenge_feed.h"
+#include "cpu_topology.h"
+#include "huge_pages.h"
+#include "nonce_space.h"
+#include "prefix_matcher.h"
+#include "solution_slot.h"
+#include "solver_registry.h"
+#include "stats.h"
+#include "trace.h"
+
+using namespace rapidjson;
+using Clock = std::chrono::steady_clock;
+
+// Counts every digest the solver checks.  Each thread gets its own counter,
+// so a relaxed load and store is enough.
+template <typename Matcher>
+class CountingMatcher {
+ public:
+  CountingMatcher(const Matcher& matcher, std::atomic<uint64_t>& attempts)
+      : matcher_(matcher), attempts_(&attempts) {}
+
+  bool operator()(const unsigned char hash[SHA256_DIGEST_LENGTH]) const {
+    attempts_->store(attempts_->load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    return matcher_(hash);
+  }
+
+ private:
+  Matcher matcher_;
+  std::atomic<uint64_t>* attempts_;
+};
+
+// Padded so two threads' counters never share a cache line.
+struct AttemptCounter {
+  std::atomic<uint64_t> value{0};
+  char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+using Job =
+    std::function<void(std::atomic<uint64_t>&, const CancellationToken&,
+                       SolutionSlot&, uint64_t, NonceCursor&, unsigned)>;
+
+// Makes the job for one round on `n_threads` workers.
+using JobFactory = std::function<Job(unsigned)>;
+
+// The same dispatch as make_solver in the miner, except every solver reports
+// its attempts.
+template <typename Registry>
+Job make_job(const Document& challenge, const unsigned n_threads) {
+  const std::string challenge_type = challenge["challenge_name"].GetString();
+  const SeedHasher seed_hasher(challenge["last_solution_hash"].GetString());
+  const std::string hash_prefix = challenge["hash_prefix"].GetString();
+
+  Job job;
+  Registry::with_solver(
+      challenge_type, challenge["parameters"], n_threads,
+      [&](const auto& solver) {
+        with_prefix_matcher(hash_prefix, [&](const auto& matcher) {
+          using Counting = CountingMatcher<std::decay_t<decltype(matcher)>>;
+          job = [=](std::atomic<uint64_t>& attempts,
+                    const CancellationToken& stop, SolutionSlot& solutions,
+                    const uint64_t epoch, NonceCursor& nonces,
+                    const unsigned worker) {
+            solver(seed_hasher, Counting(matcher, attempts), stop,
+                   solutions, epoch, nonces, worker);
+          };
+        });
+      });
+  return job;
+}
+
+struct Limits {
+  double seconds = 5;
+  uint64_t attempts = 0;  // 0 means no limit.
+};
+
+struct CellResult {
+  unsigned n_threads;
+  uint64_t rounds = 0;
+  uint64_t attempts = 0;
+  uint64_t nonces = 0;
+  uint64_t duplicate_nonces = 0;
+  double seconds = 0;
+  std::vector<double> solution_ms;
+  std::vector<double> switch_ms;
+  // The counters of stats.h around the cell.
+  stats::Snapshot stats_before;
+  stats::Snapshot stats_after;
+};
+
+// Worker i is pinned to cpus[i % cpus.size()], unless `cpus` is empty.
+CellResult run_cell(const JobFactory& new_job, const unsigned n_threads,
+                    const Limits& limits, const std::vector<int>& cpus) {
+  CellResult result;
+  result.n_threads = n_threads;
+  result.stats_before = stats::snapshot();
+  std::unique_ptr<AttemptCounter[]> counters(new AttemptCounter[n_threads]);
+
+  const auto total_attempts = [&]() {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < n_threads; ++i) {
+      total += counters[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+  };
+  const auto out_of_budget = [&](const Clock::time_point start) {
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    return elapsed.count() >= limits.seconds ||
+           (limits.attempts != 0 && total_attempts() >= limits.attempts);
+  };
+
+  // Woken up by the solver that finds the solution, like the miner's event
+  // loop is.
+  std::mutex mu;
+  std::condition_variable solution_found;
+  SolutionSlot solutions([&]() {
+    std::lock_guard<std::mutex> lock(mu);
+    solution_found.notify_one();
+  });
+
+  // Every round replays the same challenge, so the workers carry on through
+  // their nonces from one round to the next like the miner's do when the
+  // server sends a challenge again.
+  const NonceSpace nonce_space(0, 1, n_threads);
+  NonceCoverage coverage(n_threads);
+
+  // The workers stay up for the whole cell and go from one round to the
+  // next the way the miner's go from one challenge to the next.
+  ChallengeFeed challenges;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < n_threads; ++i) {
+    workers.emplace_back([&challenges, &cpus, i]() {
+      if (!cpus.empty()) {
+        cpu_topology::pin_current_thread({cpus[i % cpus.size()]});
+      }
+      challenges.work(i);
+    });
+  }
+
+  const auto cell_start = Clock::now();
+  while (!out_of_budget(cell_start)) {
+    // A job per round, like the miner's solver per challenge: the workers
+    // sharing attempts on big lists can't carry on from a stopped round.
+    const Job job = new_job(n_threads);
+    const uint64_t epoch = solutions.open();
+    const auto round_start = Clock::now();
+    const auto challenge = challenges.publish(
+        [&, job, epoch](const CancellationToken& superseded,
+                        const unsigned worker) {
+          NonceCursor nonces(nonce_space.sequence(worker),
+                             coverage.resume(worker));
+          const uint64_t start = nonces.position();
+          job(counters[worker].value, superseded, solutions, epoch, nonces,
+              worker);
+          coverage.record(worker, start, nonces.position());
+        });
+
+    bool solved = false;
+    uint64_t nonce;
+    while (!solved && !out_of_budget(cell_start)) {
+      std::unique_lock<std::mutex> lock(mu);
+      solved = solution_found.wait_for(lock, std::chrono::milliseconds(1),
+                                       [&]() { return solutions.take(nonce); });
+    }
+    const std::chrono::duration<double, std::milli> round_ms =
+        Clock::now() - round_start;
+
+    challenges.retire();
+
+    ++result.rounds;
+    if (solved) result.solution_ms.push_back(round_ms.count());
+    // Workers that hadn't switched by the end of a short round skip it.
+    if (challenge->workers_switched() > 0) {
+      const std::chrono::duration<double, std::milli> switch_ms =
+          challenge->slowest_switch();
+      result.switch_ms.push_back(switch_ms.count());
+    }
+  }
+  challenges.close();
+  for (auto& worker : workers) worker.join();
+  result.stats_after = stats::snapshot();
+
+  const std::chrono::duration<double> elapsed = Clock::now() - cell_start;
+  result.seconds = elapsed.count();
+  result.attempts = total_attempts();
+  result.nonces = coverage.attempts();
+  result.duplicate_nonces = coverage.duplicates();
+  return result;
+}
+
+double percentile(std::vector<double> values, const double p) {
+  std::sort(values.begin(), values.end());
+  const size_t rank = std::min(values.size() - 1,
+                               static_cast<size_t>(p * values.size()));
+  return values[rank];
+}
+
+// {"p50": ..., "p90": ..., "p99": ...}, or null without any values.
+void write_percentiles(Writer<StringBuffer>& writer,
+                       const std::vector<double>& values) {
+  if (values.empty()) {
+    writer.Null();
+    return;
+  }
+  writer.StartObject();
+  writer.Key("p50");
+  writer.Double(percentile(values, 0.5));
+  writer.Key("p90");
+  writer.Double(percentile(values, 0.9));
+  writer.Key("p99");
+  writer.Double(percentile(values, 0.99));
+  writer.EndObject();
+}
+
+// {"seed": ns per attempt, ...}, or null with stats compiled out.
+void write_phases(Writer<StringBuffer>& writer, const stats::Snapshot& before,
+                  const stats::Snapshot& after) {
+  if (!stats::ENABLED) {
+    writer.Null();
+    return;
+  }
+  const double tick_ns = stats::ns_per_tick(before, after);
+  const uint64_t attempts = after.attempts - before.attempts;
+  writer.StartObject();
+  for (int phase = 0; phase < stats::N_PHASES; ++phase) {
+    const uint64_t ticks =
+        after.phase_ticks[phase] - before.phase_ticks[phase];
+    if (ticks == 0) continue;
+    writer.Key(stats::PHASE_NAMES[phase]);
+    writer.Double(attempts == 0 ? 0 : ticks * tick_ns / attempts);
+  }
+  writer.EndObject();
+}
+
+std::vector<unsigned> default_thread_counts() {
+  std::vector<unsigned> counts;
+  const unsigned max_threads =
+      std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned n = 1; n < max_threads; n *= 2) counts.push_back(n);
+  counts.push_back(max_threads);
+  return counts;
+}
+
+std::vector<unsigned> parse_thread_counts(const std::string& list) {
+  std::vector<unsigned> counts;
+  size_t begin = 0;
+  while (begin < list.size()) {
+    const size_t end = std::min(list.find(',', begin), list.size());
+    counts.push_back(std::stoul(list.substr(begin, end - begin)));
+    begin = end + 1;
+  }
+  return counts;
+}
+
+void usage() {
+  std::cerr << "usage: MinerBench [--seconds S] [--attempts N] "
+               "[--threads 1,2,4] [--generic] [--kernel KERNEL=VARIANT]... "
+               "[--pin] [--huge-pages off|transparent|explicit] "
+               "[--trace FILE] FILE..."
+            << std::endl;
+  std::exit(1);
+}
+
+int main(int argc, char** argv) {
+  Limits limits;
+  std::vector<unsigned> thread_counts = default_thread_counts();
+  std::vector<std::string> files;
+  bool generic = false;
+  autotune::Overrides kernels;
+  bool pin = false;
+  std::string trace_file;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--seconds" && i + 1 < argc) {
+      limits.seconds = std::stod(argv[++i]);
+    } else if (arg == "--attempts" && i + 1 < argc) {
+      limits.attempts = std::stoull(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      thread_counts = parse_thread_counts(argv[++i]);
+    } else if (arg == "--generic") {
+      generic = true;
+    } else if (arg == "--kernel" && i + 1 < argc) {
+      if (!autotune::parse_override(argv[++i], kernels)) usage();
+    } else if (arg == "--pin") {
+      pin = true;
+    } else if (arg == "--huge-pages" && i + 1 < argc) {
+      if (!huge_pages::parse_mode(argv[++i], huge_pages::mode())) usage();
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_file = argv[++i];
+    } else if (arg.compare(0, 2, "--") == 0) {
+      usage();
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.empty()) usage();
+  autotune::run(kernels);
+  if (!trace_file.empty()) trace::enable();
+
+  std::vector<int> cpus;
+  if (pin) {
+    for (const auto& cpu :
+         cpu_topology::one_per_core(cpu_topology::allowed_cpus())) {
+      cpus.push_back(cpu.id);
+    }
+  }
+
+  StringBuffer buffer;
+  Writer<StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("results");
+  writer.StartArray();
+
+  for (const auto& file : files) {
+    std::ifstream in(file);
+    if (!in) {
+      std::cerr << "Can't open " << file << std::endl;
+      return 1;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+      Document challenge;
+      challenge.Parse(line.data());
+      if (challenge.HasParseError() || !challenge.IsObject() ||
+          !challenge.HasMember("challenge_name")) {
+        continue;
+      }
+
+      const JobFactory make = [&](const unsigned n_threads) {
+        return generic ? make_job<GenericSolvers>(challenge, n_threads)
+                       : make_job<Solvers>(challenge, n_threads);
+      };
+      if (!make(1)) {
+        std::cerr << "Unsupported challenge type: "
+                  << challenge["challenge_name"].GetString() << std::endl;
+        continue;
+      }
+
+      double single_thread_rate = 0;
+      for (const unsigned n_threads : thread_counts) {
+        const auto cell = run_cell(make, n_threads, limits, cpus);
+        const double rate = cell.attempts / cell.seconds;
+        if (n_threads == 1) single_thread_rate = rate;
+
+        writer.StartObject();
+        writer.Key("file");
+        writer.String(file.data());
+        writer.Key("challenge_name");
+        writer.String(challenge["challenge_name"].GetString());
+        writer.Key("hash_prefix");
+        writer.String(challenge["hash_prefix"].GetString());
+        writer.Key("threads");
+        writer.Uint(n_threads);
+        writer.Key("rounds");
+        writer.Uint64(cell.rounds);
+        writer.Key("solutions");
+        writer.Uint64(cell.solution_ms.size());
+        writer.Key("attempts");
+        writer.Uint64(cell.attempts);
+        // Nonces include the grids without a path, which aren't attempts.
+        writer.Key("nonces");
+        writer.Uint64(cell.nonces);
+        writer.Key("duplicate_nonces");
+        writer.Uint64(cell.duplicate_nonces);
+        writer.Key("seconds");
+        writer.Double(cell.seconds);
+        writer.Key("attempts_per_second");
+        writer.Double(rate);
+        // Per-thread rate relative to the single thread run, if there was one.
+        writer.Key("scaling_efficiency");
+        if (single_thread_rate > 0) {
+          writer.Double(rate / (n_threads * single_thread_rate));
+        } else {
+          writer.Null();
+        }
+        writer.Key("time_to_solution_ms");
+        write_percentiles(writer, cell.solution_ms);
+        // From a round starting to the last worker starting on it.
+        writer.Key("switch_latency_ms");
+        write_percentiles(writer, cell.switch_ms);
+        // Where an attempt's time went, see stats.h.
+        writer.Key("phases");
+        write_phases(writer, cell.stats_before, cell.stats_after);
+        writer.EndObject();
+      }
+    }
+  }
+
+  writer.EndArray();
+  writer.EndObject();
+  std::cout << buffer.GetString() << std::endl;
+  if (!trace_file.empty() && !trace::dump(trace_file)) {
+    std::cerr << "Can't write the trace to " << trace_file << std::endl;
+  }
+}
@@ -0,0 +1,92 @@
+// Checks MersenneTwister64 against std::mt19937_64 with every supported
+// mersenne_twister kernel.  Each generator is reseeded over and over and
+// drawn from by a random mix of operator() and generate() runs, sized to
+// stop short of, on and past the STEP words operator() twists at a time and
+// the 312 word blocks, so the lazy seeding and twisting is caught wherever
+// it falls out of step.  Exits with 1 on the first difference.
+//
+//   make mersenne_check
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "mersenne_twister.h"
+
+constexpr size_t SEEDS = 2000;
+// Outputs drawn after each seed, at least.
+constexpr size_t DRAWS = 1500;
+
+constexpr std::array<size_t, 16> RUN_LENGTHS = {
+    1, 2, 3, 15, 16, 17, 100, 155, 156, 157, 311, 312, 313, 623, 624, 1000};
+
+// Draws DRAWS or a little more outputs from both generators and compares
+// them.  Returns false after printing the first difference.
+bool draws_match(const char* kernel, const uint64_t seed,
+                 MersenneTwister64& actual, std::mt19937_64& expected,
+                 std::mt19937& script, uint64_t& outputs) {
+  std::vector<uint64_t> run;
+  size_t drawn = 0;
+  while (drawn < DRAWS) {
+    const size_t length = RUN_LENGTHS[script() % RUN_LENGTHS.size()];
+    const bool generate = script() % 2 == 0;
+    run.resize(length);
+    if (generate) {
+      actual.generate(run.data(), length);
+    } else {
+      for (auto& i : run) i = actual();
+    }
+    for (size_t i = 0; i < length; ++i) {
+      const uint64_t want = expected();
+      if (run[i] != want) {
+        std::cerr << "The " << kernel << " kernel differs from "
+                  << "std::mt19937_64 with seed " << seed << " at output "
+                  << drawn + i << ", in a run of " << length << " from "
+                  << (generate ? "generate()" : "operator()") << ": "
+                  << run[i] << " instead of " << want << '\n';
+        return false;
+      }
+    }
+    drawn += length;
+  }
+  outputs += drawn;
+  return true;
+}
+
+bool check(const char* kernel) {
+  std::mt19937 script(SEEDS);
+  uint64_t outputs = 0;
+
+  // The default seed, then reseeds of the same generator.
+  MersenneTwister64 actual;
+  std::mt19937_64 expected;
+  if (!draws_match(kernel, MersenneTwister64::DEFAULT_SEED, actual, expected,
+                   script, outputs)) {
+    return false;
+  }
+  std::mt19937_64 seeds(SEEDS);
+  for (size_t i = 0; i < SEEDS; ++i) {
+    const uint64_t seed = i == 0 ? 0 : i == 1 ? UINT64_MAX : seeds();
+    actual.seed(seed);
+    expected.seed(seed);
+    if (!draws_match(kernel, seed, actual, expected, script, outputs)) {
+      return false;
+    }
+  }
+  std::cout << "The " << kernel << " kernel matches std::mt19937_64 over "
+            << outputs << " outputs\n";
+  return true;
+}
+
+int main() {
+  auto& kernel = mersenne_twister::kernel();
+  for (const auto& variant : kernel.variants()) {
+    if (!variant.supported) continue;
+    // Generators take the kernel selected when they're built.
+    kernel.select(variant.name);
+    if (!check(variant.name)) return EXIT_FAILURE;
+  }
+}
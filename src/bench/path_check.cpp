@@ -0,0 +1,172 @@
+// Checks that the wavefront search finds the same paths as the Dijkstra one
+// it replaced, which defines the solution: on random grids, and through
+// solve_shortest_path, where every digest and every accepted nonce has to
+// match.  The grid sizes cross the 64 columns of a bitboard word.  Exits with
+// 1 on the first difference.
+//
+//   make path_check
+
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "nonce_space.h"
+#include "prefix_matcher.h"
+#include "shortest_path.h"
+#include "solution_slot.h"
+#include "wavefront_path.h"
+
+constexpr std::array<int, 8> GRID_SIZES = {10, 25, 63, 64, 65, 100, 128, 130};
+constexpr size_t GRIDS = 200;
+constexpr size_t ATTEMPTS = 200;
+
+// Fewer blockers than the server uses, and enough to wall the end off often.
+std::array<int, 2> blocker_counts(const int grid_size) {
+  return {grid_size * grid_size / 8, grid_size * grid_size / 3};
+}
+
+void print_path(const char* name, const bool found,
+                const std::vector<State>& path) {
+  std::cerr << "  " << name << ':';
+  if (!found) std::cerr << " no path";
+  for (const auto& state : path) {
+    std::cerr << " (" << state.row << ',' << state.col << ')';
+  }
+  std::cerr << '\n';
+}
+
+template <typename PathFinder>
+bool find_path(const std::vector<std::pair<uint64_t, uint64_t>>& blocked,
+               const State& start, const State& end, const int grid_size,
+               std::vector<State>& path) {
+  static const CancellationToken running;
+  PathFinder finder(grid_size);
+  finder.reset();
+  for (const auto& cell : blocked) finder.block(cell.first, cell.second);
+  return finder.find_path(start, end, running, path);
+}
+
+// Start, end and blockers anywhere inside the outer ring, like the miner's
+// grids but drawn from std::mt19937_64.
+template <typename PathFinder>
+bool check_grids(const char* name, const int grid_size, const int n_blockers) {
+  std::mt19937_64 rng(grid_size * 1000003 + n_blockers);
+  std::uniform_int_distribution<uint64_t> inside(1, grid_size - 2);
+  std::vector<std::pair<uint64_t, uint64_t>> blocked;
+  std::vector<State> expected;
+  std::vector<State> actual;
+
+  for (size_t grid = 0; grid < GRIDS; ++grid) {
+    const State start{inside(rng), inside(rng), 0};
+    State end{inside(rng), inside(rng), 0};
+    while (end.row == start.row && end.col == start.col) {
+      end = State{inside(rng), inside(rng), 0};
+    }
+    blocked.clear();
+    for (int i = 0; i < n_blockers; ++i) {
+      const uint64_t row = inside(rng);
+      const uint64_t col = inside(rng);
+      if ((row == start.row && col == start.col) ||
+          (row == end.row && col == end.col))
+        continue;
+      blocked.emplace_back(row, col);
+    }
+
+    const bool expected_found = find_path<DijkstraPathFinder>(
+        blocked, start, end, grid_size, expected);
+    const bool found =
+        find_path<PathFinder>(blocked, start, end, grid_size, actual);
+    if (found != expected_found || (found && actual != expected)) {
+      std::cerr << name << " differs on grid " << grid << " of size "
+                << grid_size << " with " << n_blockers << " blockers\n";
+      print_path("DijkstraPathFinder", expected_found, expected);
+      print_path(name, found, actual);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Records the digest of every path and stops the solver after ATTEMPTS.
+class RecordingMatcher {
+ public:
+  RecordingMatcher(CancellationToken& stop,
+                   std::vector<std::array<unsigned char, 32>>& digests)
+      : matcher_("0"), stop_(&stop), digests_(&digests) {}
+
+  bool operator()(const unsigned char* hash) const {
+    std::array<unsigned char, 32> digest;
+    std::copy(hash, hash + digest.size(), digest.begin());
+    digests_->push_back(digest);
+    if (digests_->size() == ATTEMPTS) stop_->cancel();
+    return matcher_(hash);
+  }
+
+ private:
+  PrefixMatcher matcher_;
+  CancellationToken* stop_;
+  std::vector<std::array<unsigned char, 32>>* digests_;
+};
+
+// What solve_shortest_path made of the first ATTEMPTS paths.
+struct Run {
+  std::vector<std::array<unsigned char, 32>> digests;
+  std::vector<uint64_t> accepted;
+};
+
+template <typename PathFinder>
+Run solve(const int grid_size, const int n_blockers) {
+  const SeedHasher seed_hasher(std::string(64, '0'));
+  CancellationToken stop;
+  Run run;
+  const RecordingMatcher matcher(stop, run.digests);
+  SolutionSlot solutions;
+  const uint64_t epoch = solutions.open();
+  NonceCursor nonces(NonceSpace(0, 1, 1).sequence(0), 0);
+  solve_shortest_path<PathFinder>(seed_hasher, matcher, grid_size, n_blockers,
+                                  stop, solutions, epoch, nonces);
+  uint64_t nonce;
+  while (solutions.take(nonce)) run.accepted.push_back(nonce);
+  return run;
+}
+
+template <typename PathFinder>
+bool check_solver(const char* name, const int grid_size,
+                  const int n_blockers) {
+  const Run expected = solve<DijkstraPathFinder>(grid_size, n_blockers);
+  const Run actual = solve<PathFinder>(grid_size, n_blockers);
+  if (actual.digests != expected.digests ||
+      actual.accepted != expected.accepted) {
+    std::cerr << name << " solves grids of size " << grid_size << " with "
+              << n_blockers << " blockers differently\n";
+    return false;
+  }
+  return true;
+}
+
+template <typename PathFinder>
+bool check(const char* name, const int grid_size) {
+  for (const int n_blockers : blocker_counts(grid_size)) {
+    if (!check_grids<PathFinder>(name, grid_size, n_blockers) ||
+        !check_solver<PathFinder>(name, grid_size, n_blockers)) {
+      return false;
+    }
+  }
+  std::cout << name << " matches on grids of size " << grid_size << '\n';
+  return true;
+}
+
+int main() {
+  for (const int grid_size : GRID_SIZES) {
+    if (!check<WavefrontPathFinder>("WavefrontPathFinder", grid_size)) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (!check<BasicWavefrontPathFinder<25>>("BasicWavefrontPathFinder<25>",
+                                           25)) {
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,129 @@
+// Checks SeedHasher::seeds against generate_seed with every supported
+// seed_hash kernel.  The last_solution_hash lengths fall on either side of
+// the 55 bytes that still pad out to one block and of a whole 64 or 128, and
+// the nonces run from 0 to UINT64_MAX, across every change in their number
+// of digits.  A kernel has to hash some batches in lanes itself, not leave
+// them all to OpenSSL, to pass.  Exits with 1 on the first difference.
+//
+//   make seed_check
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "multibuffer_sha256.h"
+#include "serialize.h"
+#include "sorted_list.h"
+
+using Batch = std::array<uint64_t, SEED_BATCH_SIZE>;
+
+constexpr std::array<size_t, 15> HASH_LENGTHS = {
+    0, 1, 32, 54, 55, 56, 63, 64, 65, 119, 120, 127, 128, 129, 200};
+
+// Runs of nonces, every one of them crossing into one more digit, and
+// strided like a worker's share, and random ones of every magnitude.
+std::vector<Batch> nonce_batches() {
+  std::vector<Batch> batches;
+  const auto run = [&](const uint64_t first, const uint64_t stride) {
+    Batch batch;
+    for (size_t i = 0; i < batch.size(); ++i) batch[i] = first + i * stride;
+    batches.push_back(batch);
+  };
+  run(0, 1);
+  run(UINT64_MAX - (SEED_BATCH_SIZE - 1), 1);
+  uint64_t power = 1;
+  for (int digits = 1; digits < 20; ++digits) {
+    power *= 10;
+    run(power - SEED_BATCH_SIZE / 2, 1);
+    run(power - SEED_BATCH_SIZE / 2 * 7, 7);
+  }
+
+  std::mt19937_64 rng(SEED_BATCH_SIZE);
+  for (int i = 0; i < 200; ++i) {
+    run(rng() >> (rng() % 64), 48);
+    Batch batch;
+    for (auto& nonce : batch) nonce = rng() >> (rng() % 64);
+    batches.push_back(batch);
+  }
+  return batches;
+}
+
+// A hex string like the server's hashes.
+std::string solution_hash(const size_t length, std::mt19937_64& rng) {
+  std::string hash(length, '0');
+  for (auto& c : hash) c = "0123456789abcdef"[rng() % 16];
+  return hash;
+}
+
+// Whether every message of the batch pads out to as many blocks, so the
+// kernel hashes the batch itself instead of handing it back.
+bool lines_up(const size_t hash_length, const Batch& nonces) {
+  char digits[serialize::MAX_DECIMAL_DIGITS];
+  size_t blocks = 0;
+  for (const uint64_t nonce : nonces) {
+    const size_t length =
+        hash_length % 64 + (serialize::write_decimal(nonce, digits) - digits);
+    const size_t n = multibuffer_sha256::detail::padded_blocks(length);
+    if (blocks != 0 && n != blocks) return false;
+    blocks = n;
+  }
+  return true;
+}
+
+bool check(const char* kernel, const bool batched,
+           const std::vector<Batch>& batches) {
+  std::mt19937_64 rng(HASH_LENGTHS.size());
+  std::string buffer;
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  Batch seeds;
+  size_t checked = 0;
+  size_t lined_up = 0;
+
+  for (const size_t length : HASH_LENGTHS) {
+    const std::string last_solution_hash = solution_hash(length, rng);
+    // Takes the kernel selected when it's built.
+    const SeedHasher seed_hasher(last_solution_hash);
+    for (const auto& nonces : batches) {
+      seed_hasher.seeds(nonces.data(), seeds.data());
+      for (size_t i = 0; i < nonces.size(); ++i) {
+        const uint64_t expected =
+            generate_seed(nonces[i], last_solution_hash, buffer, hash);
+        if (seeds[i] != expected) {
+          std::cerr << "The " << kernel << " kernel differs from "
+                    << "generate_seed for nonce " << nonces[i]
+                    << " after a last_solution_hash of " << length
+                    << " bytes: " << seeds[i] << " instead of " << expected
+                    << '\n';
+          return false;
+        }
+      }
+      checked += nonces.size();
+      if (lines_up(length, nonces)) ++lined_up;
+    }
+  }
+  if (batched && lined_up == 0) {
+    std::cerr << "No batch lined up for the " << kernel << " kernel\n";
+    return false;
+  }
+  std::cout << "The " << kernel << " kernel matches generate_seed on "
+            << checked << " nonces";
+  if (batched) std::cout << ", " << lined_up << " batches of them in lanes";
+  std::cout << '\n';
+  return true;
+}
+
+int main() {
+  const std::vector<Batch> batches = nonce_batches();
+  auto& kernel = multibuffer_sha256::hash_batch_kernel();
+  for (const auto& variant : kernel.variants()) {
+    if (!variant.supported) continue;
+    kernel.select(variant.name);
+    if (!check(variant.name, variant.impl != nullptr, batches)) {
+      return EXIT_FAILURE;
+    }
+  }
+}
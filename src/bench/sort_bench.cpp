@@ -0,0 +1,190 @@
+// Times RadixSorter against std::sort on the kind of lists solve_sorted_list
+// generates, to find where the radix path starts paying off, and the
+// sorting networks for the lengths NETWORK_LENGTHS instantiates them for.
+// The radix sorts are timed through the pointer overload solve_sorted_list
+// calls.  They and the networks are checked against std::sort, in both
+// orders, before anything is timed.
+//
+//   make sort_bench && ./SortBench
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "radix_sort.h"
+#include "sorting_network.h"
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Sort>
+double time_per_sort(const size_t n, Sort sort) {
+  std::mt19937_64 rng(n);
+  SortKeys list(n);
+
+  // Enough repetitions for roughly 10M elements per measurement.
+  const size_t repetitions = std::max<size_t>(10000000 / n, 3);
+  Clock::duration total{0};
+  for (size_t r = 0; r < repetitions; ++r) {
+    for (auto& i : list) i = rng();
+    const auto start = Clock::now();
+    sort(list);
+    total += Clock::now() - start;
+  }
+  return std::chrono::duration<double, std::nano>(total).count() / repetitions;
+}
+
+// Sorts `lists` lists of n random keys, one after the other, with `sort`, and
+// checks each came out the way std::sort with `compare` puts it.
+template <typename Sort, typename Compare>
+bool sorts_like_std(const size_t n, const size_t lists, Sort sort,
+                    Compare compare) {
+  std::mt19937_64 rng(n);
+  SortKeys list(n * lists);
+  for (auto& i : list) i = rng();
+  SortKeys expected = list;
+  for (size_t l = 0; l < lists; ++l) {
+    std::sort(expected.begin() + l * n, expected.begin() + (l + 1) * n,
+              compare);
+  }
+  sort(list);
+  return list == expected;
+}
+
+// Sorts the `width` lists of n keys in `keys`, one after the other, in
+// `Order` with a network batch sort, through the layout and encoding
+// solve_sorted_list_batched gives it.
+template <SortOrder Order>
+void network_sort(const sorting_network::SortBatch sort_batch, const size_t n,
+                  const size_t width, SortKeys& keys) {
+  SortKeys columns(keys.size());
+  for (size_t lane = 0; lane < width; ++lane) {
+    for (size_t i = 0; i < n; ++i) {
+      columns[i * width + lane] =
+          sorting_network::encode<Order>(keys[lane * n + i]);
+    }
+  }
+  sort_batch(columns.data());
+  for (size_t lane = 0; lane < width; ++lane) {
+    for (size_t i = 0; i < n; ++i) {
+      keys[lane * n + i] =
+          sorting_network::encode<Order>(columns[i * width + lane]);
+    }
+  }
+}
+
+// The list lengths of the server's challenges so far.
+constexpr size_t SERVER_LENGTH = 100;
+
+// The lengths timed below up to sorting_network::MAX_ELEMENTS.
+using NETWORK_LENGTHS = std::index_sequence<8, 12, 16, 24, 32, 48, 64, 96,
+                                            SERVER_LENGTH, 128, 192, 256>;
+
+// Nanoseconds per list sorted by the network `width` lanes wide, or 0 if
+// there's no such kernel for n.
+double network_ns(size_t, size_t, std::index_sequence<>) { return 0; }
+
+template <size_t Length, size_t... Rest>
+double network_ns(const size_t n, const size_t width,
+                  std::index_sequence<Length, Rest...>) {
+  if (n != Length) {
+    return network_ns(n, width, std::index_sequence<Rest...>());
+  }
+  const auto sort_batch = sorting_network::sort_batch<Length>(width);
+  if (sort_batch == nullptr) return 0;
+  // A batch is `width` lists side by side, so a list's time is the batch's
+  // over `width`.
+  return time_per_sort(n * width, [&](SortKeys& l) {
+           sort_batch(l.data());
+         }) /
+         width;
+}
+
+double network_ns(const size_t n, const size_t width) {
+  return network_ns(n, width, NETWORK_LENGTHS());
+}
+
+// Whether the networks `width` lanes wide sort every length in both orders
+// the way std::sort does.
+bool networks_sort_like_std(size_t, std::index_sequence<>) { return true; }
+
+template <size_t Length, size_t... Rest>
+bool networks_sort_like_std(const size_t width,
+                            std::index_sequence<Length, Rest...>) {
+  const auto sort_batch = sorting_network::sort_batch<Length>(width);
+  if (sort_batch != nullptr) {
+    const auto ascending = [&](SortKeys& keys) {
+      network_sort<SortOrder::ASCENDING>(sort_batch, Length, width, keys);
+    };
+    const auto descending = [&](SortKeys& keys) {
+      network_sort<SortOrder::DESCENDING>(sort_batch, Length, width, keys);
+    };
+    if (!sorts_like_std(Length, width, ascending, std::less<uint64_t>()) ||
+        !sorts_like_std(Length, width, descending,
+                        std::greater<uint64_t>())) {
+      std::cerr << "The network " << width
+                << " lanes wide disagrees with std::sort for n = " << Length
+                << '\n';
+      return false;
+    }
+  }
+  return networks_sort_like_std(width, std::index_sequence<Rest...>());
+}
+
+int main() {
+  RadixSorter<SortOrder::ASCENDING> ascending;
+  RadixSorter<SortOrder::DESCENDING> descending;
+
+  const bool avx512 = cpu_dispatch::has_avx512();
+  const bool avx2 = cpu_dispatch::has_avx2();
+  if ((avx2 && !networks_sort_like_std(4, NETWORK_LENGTHS())) ||
+      (avx512 && !networks_sort_like_std(8, NETWORK_LENGTHS()))) {
+    return EXIT_FAILURE;
+  }
+
+  // The network columns are empty for lengths without a network, and on
+  // CPUs without the instruction set.
+  std::cout << "n,std_sort_ns,radix_ascending_ns,radix_descending_ns,"
+               "network_avx2_ns,network_avx512_ns\n";
+  std::vector<size_t> sizes = {SERVER_LENGTH};
+  for (size_t n = 8; n <= (size_t(1) << 22); n *= 2) {
+    sizes.push_back(n);
+    sizes.push_back(n + n / 2);
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  const auto radix_ascending = [&](SortKeys& l) {
+    ascending.sort(l.data(), l.size());
+  };
+  const auto radix_descending = [&](SortKeys& l) {
+    descending.sort(l.data(), l.size());
+  };
+
+  for (const size_t size : sizes) {
+    if (!sorts_like_std(size, 1, radix_ascending, std::less<uint64_t>()) ||
+        !sorts_like_std(size, 1, radix_descending,
+                        std::greater<uint64_t>())) {
+      std::cerr << "RadixSorter disagrees with std::sort for n = " << size
+                << '\n';
+      return EXIT_FAILURE;
+    }
+    const auto std_ns = time_per_sort(size, [](SortKeys& l) {
+      std::sort(l.begin(), l.end());
+    });
+    const auto asc_ns = time_per_sort(size, radix_ascending);
+    const auto desc_ns = time_per_sort(size, radix_descending);
+    std::cout << size << ',' << std_ns << ',' << asc_ns << ',' << desc_ns
+              << ',';
+    const double avx2_ns = avx2 ? network_ns(size, 4) : 0;
+    if (avx2_ns > 0) std::cout << avx2_ns;
+    std::cout << ',';
+    const double avx512_ns = avx512 ? network_ns(size, 8) : 0;
+    if (avx512_ns > 0) std::cout << avx512_ns;
+    std::cout << '\n';
+  }
+}
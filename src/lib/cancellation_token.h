@@ -0,0 +1,26 @@
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <atomic>
+
+// Tells long running work it should wrap up.  Work only ever reads it
+// (`while (!token) { ... }`); whoever owns it cancels and resets it.
+class CancellationToken {
+ public:
+  CancellationToken() : cancelled_(false) {}
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+  void reset() { cancelled_.store(false, std::memory_order_relaxed); }
+
+  // Polled on every attempt, so it is a plain load; a worker noticing the
+  // cancellation one attempt late doesn't matter.
+  bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+  explicit operator bool() const { return cancelled(); }
+
+ private:
+  std::atomic<bool> cancelled_;
+};
+
+#endif /* CANCELLATION_TOKEN_H */
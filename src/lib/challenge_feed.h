@@ -0,0 +1,159 @@
+#ifndef CHALLENGE_FEED_H
+#define CHALLENGE_FEED_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "cancellation_token.h"
+#include "trace.h"
+
+// One published challenge.  Workers keep a reference to it for as long as
+// they work on it, so it stays valid after it has been replaced.
+class Challenge {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Works on the challenge until the token is cancelled.
+  // `worker` is the index of the calling worker, which picks its share of
+  // the nonces.
+  using Solve =
+      std::function<void(const CancellationToken& superseded, unsigned worker)>;
+
+  explicit Challenge(Solve solve) : solve_(std::move(solve)) {}
+
+  uint64_t version() const { return version_; }
+
+  // How many workers started on the challenge, and how long after it was
+  // published the last of them did.
+  unsigned workers_switched() const {
+    return workers_switched_.load(std::memory_order_relaxed);
+  }
+  std::chrono::nanoseconds slowest_switch() const {
+    return std::chrono::nanoseconds(
+        slowest_switch_ns_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  friend class ChallengeFeed;
+
+  const Solve solve_;
+  uint64_t version_ = 0;
+  Clock::time_point published_at_;
+  CancellationToken superseded_;
+  std::atomic<unsigned> workers_switched_{0};
+  std::atomic<int64_t> slowest_switch_ns_{0};
+
+  void record_switch() {
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - published_at_)
+                           .count();
+    int64_t slowest = slowest_switch_ns_.load(std::memory_order_relaxed);
+    while (ns > slowest &&
+           !slowest_switch_ns_.compare_exchange_weak(
+               slowest, ns, std::memory_order_relaxed)) {
+    }
+    workers_switched_.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+// Lets long lived workers follow the current challenge without ever being
+// joined or restarted.  Publishing swaps in the new challenge and cancels the
+// token of the old one, which the solvers check every attempt, so every
+// worker moves over one attempt later.  Nothing on the publishing side waits
+// for the workers.
+//
+// Workers only take the mutex when they switch; while solving all they touch
+// is the token of the challenge they hold.
+class ChallengeFeed {
+ public:
+  ChallengeFeed() = default;
+  ChallengeFeed(const ChallengeFeed&) = delete;
+  ChallengeFeed& operator=(const ChallengeFeed&) = delete;
+
+  // Replaces the current challenge.
+  std::shared_ptr<const Challenge> publish(Challenge::Solve solve) {
+    auto challenge = std::make_shared<Challenge>(std::move(solve));
+    std::shared_ptr<Challenge> previous;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      challenge->version_ = ++version_;
+      challenge->published_at_ = Challenge::Clock::now();
+      previous = std::move(current_);
+      current_ = challenge;
+    }
+    if (previous) previous->superseded_.cancel();
+    changed_.notify_all();
+    return challenge;
+  }
+
+  // Stops work on the current challenge; workers idle until the next one.
+  void retire() {
+    std::shared_ptr<Challenge> previous;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      previous = std::move(current_);
+    }
+    if (previous) previous->superseded_.cancel();
+  }
+
+  // Makes every work() call return.
+  void close() {
+    std::shared_ptr<Challenge> previous;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      closed_ = true;
+      previous = std::move(current_);
+    }
+    if (previous) previous->superseded_.cancel();
+    changed_.notify_all();
+  }
+
+  // Runs a worker: solves every challenge published until close().
+  void work(const unsigned worker) {
+    trace::name_thread("worker " + std::to_string(worker));
+    uint64_t seen = 0;
+    while (true) {
+      std::shared_ptr<Challenge> challenge;
+      {
+        const trace::Span waiting("wait");
+        challenge = next(seen);
+      }
+      if (!challenge) return;
+      seen = challenge->version_;
+      const trace::Span solving("solve", "challenge", seen);
+      challenge->solve_(challenge->superseded_, worker);
+    }
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable changed_;
+  std::shared_ptr<Challenge> current_;
+  uint64_t version_ = 0;
+  bool closed_ = false;
+
+  // Waits for a challenge other than version `seen`.  Returns null once the
+  // feed is closed.
+  std::shared_ptr<Challenge> next(const uint64_t seen) {
+    std::shared_ptr<Challenge> challenge;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      changed_.wait(lock, [&] {
+        return closed_ || (current_ && current_->version_ != seen);
+      });
+      if (closed_) return nullptr;
+      challenge = current_;
+    }
+    challenge->record_switch();
+    return challenge;
+  }
+};
+
+#endif /* CHALLENGE_FEED_H */
@@ -0,0 +1,129 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Which logical CPUs this process may run on, which physical core and NUMA
+// node each belongs to, and pinning threads to them.  Read from sysfs, so it
+// all comes out empty (and pinning fails) anywhere but Linux.
+namespace cpu_topology {
+
+struct Cpu {
+  int id;
+  // Hyperthreads of one core share its package and core.
+  int package;
+  int core;
+  int node;
+};
+
+namespace detail {
+
+// The integer in a sysfs file, or `otherwise` if there's none.
+inline int read_int(const std::string& path, const int otherwise) {
+  std::ifstream in(path);
+  int value;
+  return in >> value ? value : otherwise;
+}
+
+// Whether `cpu` is in a list like "0-3,8-11", as sysfs writes them.
+inline bool in_cpu_list(const std::string& list, const int cpu) {
+  size_t begin = 0;
+  while (begin < list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) end = list.size();
+    const std::string range = list.substr(begin, end - begin);
+    const size_t dash = range.find('-');
+    const int first = std::stoi(range);
+    const int last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    if (first <= cpu && cpu <= last) return true;
+    begin = end + 1;
+  }
+  return false;
+}
+
+inline int node_of(const int cpu) {
+  for (int node = 0;; ++node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+    std::string list;
+    if (!(in >> list)) return 0;
+    if (in_cpu_list(list, cpu)) return node;
+  }
+}
+
+}  // namespace detail
+
+// The CPUs in this process's affinity mask, by id.
+inline std::vector<Cpu> allowed_cpus() {
+  std::vector<Cpu> cpus;
+#if defined(__linux__)
+  cpu_set_t mask;
+  if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return cpus;
+  for (int id = 0; id < CPU_SETSIZE; ++id) {
+    if (!CPU_ISSET(id, &mask)) continue;
+    const std::string topology =
+        "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+    cpus.push_back(Cpu{id,
+                       detail::read_int(topology + "physical_package_id", 0),
+                       detail::read_int(topology + "core_id", id),
+                       detail::node_of(id)});
+  }
+#endif
+  return cpus;
+}
+
+// The first CPU of every physical core, node by node, so the first n cover
+// as few nodes as they can.
+inline std::vector<Cpu> one_per_core(std::vector<Cpu> cpus) {
+  std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+    return std::tie(a.node, a.package, a.core, a.id) <
+           std::tie(b.node, b.package, b.core, b.id);
+  });
+  cpus.erase(std::unique(cpus.begin(), cpus.end(),
+                         [](const Cpu& a, const Cpu& b) {
+                           return a.package == b.package && a.core == b.core;
+                         }),
+             cpus.end());
+  return cpus;
+}
+
+// Every CPU of `cpus` on the same physical core as `cpu`, `cpu` included.
+inline std::vector<int> siblings(const std::vector<Cpu>& cpus,
+                                 const Cpu& cpu) {
+  std::vector<int> ids;
+  for (const auto& other : cpus) {
+    if (other.package == cpu.package && other.core == cpu.core) {
+      ids.push_back(other.id);
+    }
+  }
+  return ids;
+}
+
+// Keeps the calling thread on `cpus` from now on.  Memory it touches first
+// from then on is allocated on their node by the kernel's default policy.
+inline bool pin_current_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (const int id : cpus) CPU_SET(id, &mask);
+  return !cpus.empty() &&
+         pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+}  // namespace cpu_topology
+
+#endif /* CPU_TOPOLOGY_H */
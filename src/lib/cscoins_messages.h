@@ -0,0 +1,365 @@
+#ifndef CSCOINS_MESSAGES_H
+#define CSCOINS_MESSAGES_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Hub.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "cscoins_wallet.h"
+
+// The commands the miner and the proxy send, to the CS Games server and to
+// each other.  Both speak the server's protocol, plus two commands of their
+// own between a proxy and its miners:
+//
+//   proxy -> miner  {"command": "nonce_space",
+//                    "args": {"process": 2, "processes": 16}}
+//   miner -> proxy  {"command": "proxy_submission",
+//                    "args": {"challenge_id": 7, "nonce": "1234"}}
+//
+// and the answer to a submission the mock server sends, which the proxy also
+// sends the miner whose submission it was:
+//
+//   {"type": "submission_result", "challenge_id": 7, "nonce": "1234",
+//    "accepted": true}
+
+namespace cscoins_messages {
+
+inline rapidjson::Document parse_json(const std::string& message) {
+  rapidjson::Document d;
+  d.Parse(message.data());
+  return d;
+}
+
+// Parses one message after the other into the same memory.  A frame is
+// copied into a buffer kept from one message to the next and parsed in
+// place, so strings point into the buffer, and the values and the parse
+// stack come out of arenas allocated up front.  Once the buffer has grown to
+// the biggest message, parsing allocates nothing.
+//
+// What parse() returns is only valid until the next call.
+class MessageParser {
+ public:
+  using Allocator = rapidjson::MemoryPoolAllocator<>;
+  using Document =
+      rapidjson::GenericDocument<rapidjson::UTF8<>, Allocator, Allocator>;
+
+  // Bytes of values and of parse stack that fit in the arenas; anything
+  // beyond comes from the heap.
+  static constexpr size_t ARENA_SIZE = 64 << 10;
+
+  MessageParser()
+      : values_arena_(new uint64_t[ARENA_SIZE / sizeof(uint64_t)]),
+        stack_arena_(new uint64_t[ARENA_SIZE / sizeof(uint64_t)]),
+        values_(values_arena_.get(), ARENA_SIZE),
+        stack_(stack_arena_.get(), ARENA_SIZE),
+        document_(&values_, STACK_CAPACITY, &stack_) {
+    buffer_.reserve(4096);
+  }
+  MessageParser(const MessageParser&) = delete;
+  MessageParser& operator=(const MessageParser&) = delete;
+
+  const Document& parse(const char* message, const size_t length) {
+    if (buffer_.size() < length + 1) buffer_.resize(length + 1);
+    std::memcpy(buffer_.data(), message, length);
+    buffer_[length] = '\0';
+    // The previous document's values go with the arena; they need no
+    // destructor.
+    values_.Clear();
+    stack_.Clear();
+    document_.ParseInsitu(buffer_.data());
+    return document_;
+  }
+
+ private:
+  static constexpr size_t STACK_CAPACITY = 1024;
+
+  std::unique_ptr<uint64_t[]> values_arena_;
+  std::unique_ptr<uint64_t[]> stack_arena_;
+  Allocator values_;
+  Allocator stack_;
+  Document document_;
+  std::vector<char> buffer_;
+};
+
+inline bool is_challenge_message(const rapidjson::Value& d) {
+  return d.IsObject() && d.HasMember("challenge_name");
+}
+
+// The command of a message sent to the server or the proxy, or "".
+inline std::string command_of(const rapidjson::Value& d) {
+  if (!d.IsObject() || !d.HasMember("command") || !d["command"].IsString()) {
+    return "";
+  }
+  return d["command"].GetString();
+}
+
+inline bool is_error(const rapidjson::Value& d) {
+  return d.IsObject() && d.HasMember("error");
+}
+
+// The nonce field of `d`, a decimal string.  Returns false if it's missing
+// or malformed.
+inline bool parse_nonce(const rapidjson::Value& d, uint64_t& nonce) {
+  if (!d.IsObject() || !d.HasMember("nonce") || !d["nonce"].IsString()) {
+    return false;
+  }
+  const char* digits = d["nonce"].GetString();
+  const size_t n_digits = d["nonce"].GetStringLength();
+  if (n_digits == 0) return false;
+  nonce = 0;
+  for (size_t i = 0; i < n_digits; ++i) {
+    if (digits[i] < '0' || digits[i] > '9') return false;
+    const unsigned digit = digits[i] - '0';
+    if (nonce > (UINT64_MAX - digit) / 10) return false;
+    nonce = nonce * 10 + digit;
+  }
+  return true;
+}
+
+// The challenge id and nonce fields of `d`.  Returns false if either is
+// missing or malformed.
+inline bool parse_challenge_and_nonce(const rapidjson::Value& d,
+                                      uint64_t& challenge_id,
+                                      uint64_t& nonce) {
+  if (!d.IsObject() || !d.HasMember("challenge_id") ||
+      !d["challenge_id"].IsUint64() || !parse_nonce(d, nonce)) {
+    return false;
+  }
+  challenge_id = d["challenge_id"].GetUint64();
+  return true;
+}
+
+// The challenge and nonce of a miner's proxy_submission.  Returns false if
+// either is missing or malformed; miners aren't trusted with the proxy's
+// connection.
+inline bool parse_proxy_submission(const rapidjson::Value& d,
+                                   uint64_t& challenge_id, uint64_t& nonce) {
+  return d.IsObject() && d.HasMember("args") &&
+         parse_challenge_and_nonce(d["args"], challenge_id, nonce);
+}
+
+// The wallet and nonce of a submission, for the mock server.  Returns false
+// if either is missing or malformed.
+inline bool parse_submission(const rapidjson::Value& d,
+                             std::string& wallet_id, uint64_t& nonce) {
+  if (!d.IsObject() || !d.HasMember("args")) return false;
+  const auto& args = d["args"];
+  if (!args.IsObject() || !args.HasMember("wallet_id") ||
+      !args["wallet_id"].IsString() || !parse_nonce(args, nonce)) {
+    return false;
+  }
+  wallet_id.assign(args["wallet_id"].GetString(),
+                   args["wallet_id"].GetStringLength());
+  return true;
+}
+
+// Whether `d` is a submission_result, and if so for which submission and
+// whether it was accepted.
+inline bool is_submission_result(const rapidjson::Value& d,
+                                 uint64_t& challenge_id, uint64_t& nonce,
+                                 bool& accepted) {
+  if (!d.IsObject() || !d.HasMember("type") || !d["type"].IsString() ||
+      std::strcmp(d["type"].GetString(), "submission_result") != 0 ||
+      !parse_challenge_and_nonce(d, challenge_id, nonce)) {
+    return false;
+  }
+  accepted = d.HasMember("accepted") && d["accepted"].IsBool() &&
+             d["accepted"].GetBool();
+  return true;
+}
+
+// Tells which command each of the server's answers is for.  The server
+// answers every command, in order, but only a challenge says what it answers
+// (get_current_challenge): an error is just {"error": ...}, and an accepted
+// submission gets anything else.  New challenges also come in unasked,
+// between answers.
+class ServerReplies {
+ public:
+  enum Command { REGISTRATION, CHALLENGE, SUBMISSION };
+
+  struct Sent {
+    Command command;
+    // Of a SUBMISSION.
+    uint64_t nonce;
+  };
+
+  // A new connection owes no answers.
+  void reset() { sent_.clear(); }
+
+  void sent(const Command command, const uint64_t nonce = 0) {
+    sent_.push_back(Sent{command, nonce});
+  }
+
+  // Whether `d` answers a command, and if so which.  A challenge only
+  // answers get_current_challenge; when another command is owed an answer
+  // first, it came unasked.
+  bool answered(const rapidjson::Value& d, Sent& command) {
+    if (sent_.empty()) return false;
+    if (is_challenge_message(d) && sent_.front().command != CHALLENGE) {
+      return false;
+    }
+    command = sent_.front();
+    sent_.pop_front();
+    return true;
+  }
+
+ private:
+  std::deque<Sent> sent_;
+};
+
+// The fields of a challenge message the miner goes by, copied out of it once
+// since the parser reuses its memory, and read only from then on.  Its
+// parameters are only read while the message is at hand.
+struct ChallengeDescriptor {
+  explicit ChallengeDescriptor(const rapidjson::Value& message)
+      : id(message["challenge_id"].GetUint64()),
+        name(message["challenge_name"].GetString()),
+        last_solution_hash(message["last_solution_hash"].GetString()),
+        hash_prefix(message["hash_prefix"].GetString()) {}
+
+  const uint64_t id;
+  const std::string name;
+  const std::string last_solution_hash;
+  const std::string hash_prefix;
+};
+
+// A submission rendered ahead of time but for the nonce, whose digits
+// render() writes in place, so sending one allocates nothing.
+class SubmissionTemplate {
+ public:
+  SubmissionTemplate() = default;
+
+  // The message is `before`, the nonce in decimal and then `after`.
+  SubmissionTemplate(const std::string& before, const std::string& after)
+      : message_(before.size() + MAX_DIGITS + after.size(), '\0'),
+        nonce_at_(before.size()),
+        after_(after) {
+    message_.replace(0, before.size(), before);
+  }
+
+  bool empty() const { return message_.empty(); }
+
+  // The message for `nonce`, valid until the next call.
+  const char* render(uint64_t nonce, size_t& length) {
+    char digits[MAX_DIGITS];
+    char* first = digits + MAX_DIGITS;
+    do {
+      *--first = '0' + nonce % 10;
+      nonce /= 10;
+    } while (nonce != 0);
+    const size_t n_digits = digits + MAX_DIGITS - first;
+    char* out = &message_[nonce_at_];
+    std::memcpy(out, first, n_digits);
+    std::memcpy(out + n_digits, after_.data(), after_.size());
+    length = nonce_at_ + n_digits + after_.size();
+    return message_.data();
+  }
+
+ private:
+  static constexpr size_t MAX_DIGITS = 20;
+
+  std::string message_;
+  size_t nonce_at_ = 0;
+  std::string after_;
+};
+
+inline void send_submission(uWS::WebSocket<uWS::CLIENT>& ws,
+                            SubmissionTemplate& submission,
+                            const uint64_t nonce) {
+  size_t length;
+  const char* message = submission.render(nonce, length);
+  ws.send(message, length, uWS::OpCode::TEXT);
+}
+
+inline void send_registration(uWS::WebSocket<uWS::CLIENT>& ws,
+                              const cscoins_wallet::CSCoinsWallet& wallet) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("command");
+  writer.String("register_wallet");
+  writer.Key("args");
+  writer.StartObject();
+  writer.Key("name");
+  writer.String("DanglingPointers");
+  writer.Key("key");
+  writer.String(wallet.public_key().data());
+  writer.Key("signature");
+  writer.String(wallet.registration_signature().data());
+  writer.EndObject();
+  writer.EndObject();
+
+  ws.send(buffer.GetString());
+}
+
+// The wallet id is hex, so it needs no escaping.
+inline SubmissionTemplate submission_template(const std::string& wallet_id) {
+  return SubmissionTemplate(
+      "{\"command\":\"submission\",\"args\":{\"wallet_id\":\"" + wallet_id +
+          "\",\"nonce\":\"",
+      "\"}}");
+}
+
+inline void send_submission_result(uWS::WebSocket<uWS::SERVER>& ws,
+                                   const uint64_t challenge_id,
+                                   const uint64_t nonce,
+                                   const bool accepted) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("type");
+  writer.String("submission_result");
+  writer.Key("challenge_id");
+  writer.Uint64(challenge_id);
+  writer.Key("nonce");
+  const std::string digits = std::to_string(nonce);
+  writer.String(digits.data(), digits.size());
+  writer.Key("accepted");
+  writer.Bool(accepted);
+  writer.EndObject();
+
+  ws.send(buffer.GetString());
+}
+
+inline void send_nonce_space(uWS::WebSocket<uWS::SERVER>& ws,
+                             const unsigned process,
+                             const unsigned n_processes) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("command");
+  writer.String("nonce_space");
+  writer.Key("args");
+  writer.StartObject();
+  writer.Key("process");
+  writer.Uint(process);
+  writer.Key("processes");
+  writer.Uint(n_processes);
+  writer.EndObject();
+  writer.EndObject();
+
+  ws.send(buffer.GetString());
+}
+
+// The proxy submits under its own wallet, and needs the challenge to tell a
+// late solution to the previous one apart.
+inline SubmissionTemplate proxy_submission_template(
+    const uint64_t challenge_id) {
+  return SubmissionTemplate(
+      "{\"command\":\"proxy_submission\",\"args\":{\"challenge_id\":" +
+          std::to_string(challenge_id) + ",\"nonce\":\"",
+      "\"}}");
+}
+
+}  // namespace cscoins_messages
+
+#endif /* CSCOINS_MESSAGES_H */
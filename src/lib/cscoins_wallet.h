@@ -1,11 +1,13 @@
 #ifndef CSCOINS_WALLET_H
 #define CSCOINS_WALLET_H
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <random>
+#include <sstream>
 #include <streambuf>
 #include <string>
 #include <vector>
@@ -66,38 +68,126 @@ bool keys_are_pair(const RSAPtr& public_key, const RSAPtr& private_key) {
   return msg == decrypted;
 }
 
+// The whole file, or an empty string if it can't be read.
+std::string read_file(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+std::string hex(const unsigned char* bytes, const size_t n) {
+  static const char DIGITS[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < n; ++i) {
+    hex.push_back(DIGITS[bytes[i] >> 4]);
+    hex.push_back(DIGITS[bytes[i] & 0x0F]);
+  }
+  return hex;
+}
+
+std::string sha256_hex(const std::string& data) {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(),
+         digest);
+  return hex(digest, SHA256_DIGEST_LENGTH);
+}
+
+// What checking the keys and signing the registration worked out, for as
+// long as the key files hash the same.  A line each: the version, the
+// SHA-256 of the public PEM, private PEM and public DER files, the wallet id
+// and the registration signature.
+struct WalletCache {
+  static constexpr const char* VERSION = "dangminer-wallet-cache 1";
+
+  std::string key_hashes[3];
+  std::string wallet_id;
+  std::string registration_signature;
+
+  // False if there's no cache at `path` or it isn't one.
+  bool load(const std::string& path) {
+    std::ifstream file(path);
+    std::string version;
+    if (!std::getline(file, version) || version != VERSION) return false;
+    for (auto& hash : key_hashes) std::getline(file, hash);
+    std::getline(file, wallet_id);
+    return bool(std::getline(file, registration_signature)) &&
+           !registration_signature.empty();
+  }
+
+  // Written next to `path` and renamed over it, so a miner starting
+  // meanwhile never reads half of it.
+  bool save(const std::string& path) const {
+    const std::string temporary = path + ".tmp";
+    {
+      std::ofstream file(temporary);
+      file << VERSION << '\n';
+      for (const auto& hash : key_hashes) file << hash << '\n';
+      file << wallet_id << '\n' << registration_signature << '\n';
+      file.close();
+      if (!file) return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+  }
+};
+
 }  // namespace detail
 
 class CSCoinsWallet {
  public:
+  // Checking that the keys are sound and a pair, and signing the
+  // registration, is most of what starting up costs.  Given a `cache_file`,
+  // that's only done when the key files have changed since it was written;
+  // until then the private key isn't even read unless something is signed.
   CSCoinsWallet(const std::string& public_key_file,
                 const std::string& private_key_file,
-                const std::string& der_file) {
+                const std::string& der_file,
+                const std::string& cache_file = "")
+      : private_key_file_(private_key_file) {
+    public_key_str_ = detail::read_file(public_key_file);
+    detail::WalletCache cache;
+    const std::string key_hashes[3] = {
+        detail::sha256_hex(public_key_str_),
+        detail::sha256_hex(detail::read_file(private_key_file)),
+        detail::sha256_hex(detail::read_file(der_file))};
+    if (!cache_file.empty() && cache.load(cache_file) &&
+        std::equal(key_hashes, key_hashes + 3, cache.key_hashes)) {
+      wallet_id_ = cache.wallet_id;
+      register_sig_ = cache.registration_signature;
+      from_cache_ = true;
+      return;
+    }
+
     load_keys_from_file(public_key_file, private_key_file);
     generate_wallet_id(der_file);
+    if (cache_file.empty()) return;
+    std::copy(key_hashes, key_hashes + 3, cache.key_hashes);
+    cache.wallet_id = wallet_id_;
+    cache.registration_signature = register_sig_;
+    if (!cache.save(cache_file)) {
+      std::cerr << "Can't write the wallet cache " << cache_file << std::endl;
+    }
   }
 
   const std::string& wallet_id() const { return wallet_id_; }
   const std::string& public_key() const { return public_key_str_; }
   const std::string& registration_signature() const { return register_sig_; }
 
+  // Whether the wallet id and registration came from the cache.
+  bool from_cache() const { return from_cache_; }
+
   std::string stringify(const unsigned char* digest,
                         const unsigned int len) const {
-    const auto f = [](char c) { return c < 10 ? '0' + c : 'a' + (c - 10); };
-    std::string stringified;
-    for (unsigned i = 0; i < len; ++i) {
-      stringified.push_back(f(digest[i] >> 4));
-      stringified.push_back(f(digest[i] & 0x0F));
-    }
-    return stringified;
+    return detail::hex(digest, len);
   }
 
   std::string sign_digest(
       const unsigned char digest[SHA256_DIGEST_LENGTH]) const {
-    std::vector<unsigned char> signature(RSA_size(private_key_.get()), 0);
+    RSA* key = private_key();
+    std::vector<unsigned char> signature(RSA_size(key), 0);
     unsigned int siglen = 0;
     RSA_sign(NID_sha256, digest, SHA256_DIGEST_LENGTH, signature.data(),
-             &siglen, private_key_.get());
+             &siglen, key);
     return stringify(signature.data(), siglen);
   }
 
@@ -110,9 +200,25 @@ class CSCoinsWallet {
  private:
   std::string register_sig_;
   detail::RSAPtr public_key_;
-  detail::RSAPtr private_key_;
+  // Read on first use when the cache saved checking it.
+  mutable detail::RSAPtr private_key_;
+  std::string private_key_file_;
   std::string wallet_id_;
   std::string public_key_str_;
+  bool from_cache_ = false;
+
+  // The cache only matched if the file is the one checked when it was
+  // written.
+  RSA* private_key() const {
+    if (!private_key_) {
+      detail::FilePtr file{fopen(private_key_file_.c_str(), "r")};
+      detail::CHECK(file, "Error opening private key file.");
+      private_key_.reset(
+          PEM_read_RSAPrivateKey(file.get(), nullptr, nullptr, nullptr));
+      detail::CHECK(private_key_, "Error reading private key file.");
+    }
+    return private_key_.get();
+  }
 
   void generate_wallet_id(const std::string& public_der_path) {
     std::ifstream public_der_file(public_der_path);
@@ -159,11 +265,6 @@ class CSCoinsWallet {
 
     CHECK(keys_are_pair(public_key_, private_key_),
           "These public/private keys aren't a pair.");
-
-    std::fstream s(public_path);
-    std::noskipws(s);
-    public_key_str_ = std::string(std::istream_iterator<char>(s),
-                                  std::istream_iterator<char>());
   }
 };
 
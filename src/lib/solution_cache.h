@@ -0,0 +1,320 @@
+#ifndef SOLUTION_CACHE_H
+#define SOLUTION_CACHE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What earlier runs found out about challenges, so a miner restarting or
+// reconnecting in the middle of one picks up where it was: the solutions it
+// found, to submit again right away, and how far each worker got through its
+// share of the nonces, to skip.
+//
+// The file is a header and then fixed size records, only ever appended to.
+// Every record carries a checksum, so one torn by a crash is told apart from
+// a whole one: opening the file maps it, replays the records up to the first
+// bad one and cuts the file there.  Once it holds MAX_RECORDS it's rewritten
+// with what the MAX_KEPT challenges seen last need, and renamed over.
+//
+// Records aren't synced to disk, so they outlive the miner crashing but not
+// the machine.  Only one thread may use it.
+namespace solution_cache_detail {
+
+// A REJECTED record takes back an earlier SOLUTION.
+enum Kind : uint32_t { SOLUTION = 1, SEARCHED = 2, REJECTED = 3 };
+
+struct Record {
+  // SolutionCache::key() of the challenge, or of the share for SEARCHED.
+  uint64_t key;
+  // The nonce, or the position the worker reached in its sequence.
+  uint64_t value;
+  uint32_t kind;
+  uint32_t worker;
+  uint64_t checksum;
+};
+static_assert(sizeof(Record) == 32, "Records are laid out for the file.");
+
+// The header is a record's worth of bytes, so records stay aligned.
+constexpr size_t HEADER_SIZE = sizeof(Record);
+constexpr char MAGIC[] = "dangminer solutions 1";
+
+// FNV-1a over everything but the checksum.  Never 0 for a zeroed record, so
+// the zeros a crash may leave past the last write don't pass for one.
+inline uint64_t checksum(const Record& record) {
+  unsigned char bytes[offsetof(Record, checksum)];
+  std::memcpy(bytes, &record, sizeof(bytes));
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const unsigned char byte : bytes) {
+    hash = (hash ^ byte) * 0x100000001b3;
+  }
+  return hash;
+}
+
+inline bool well_formed(const Record& record) {
+  return (record.kind == SOLUTION || record.kind == SEARCHED ||
+          record.kind == REJECTED) &&
+         record.checksum == checksum(record);
+}
+
+inline bool write_all(const int fd, const void* data, const size_t size) {
+  const char* p = static_cast<const char*>(data);
+  size_t written = 0;
+  while (written < size) {
+    const ssize_t n = ::write(fd, p + written, size - written);
+    if (n <= 0) return false;
+    written += n;
+  }
+  return true;
+}
+
+inline bool write_header(const int fd) {
+  char header[HEADER_SIZE] = {};
+  std::memcpy(header, MAGIC, sizeof(MAGIC));
+  return write_all(fd, header, sizeof(header));
+}
+
+}  // namespace solution_cache_detail
+
+class SolutionCache {
+ public:
+  static constexpr size_t MAX_RECORDS = size_t(1) << 16;
+  static constexpr size_t MAX_KEPT = 64;
+
+  // A key for whatever `identity` spells out: a challenge, or one share of
+  // its nonces.
+  static uint64_t key(const std::string& identity) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(identity.data()),
+           identity.size(), digest);
+    uint64_t key;
+    std::memcpy(&key, digest, sizeof(key));
+    return key;
+  }
+
+  // Opens the cache at `path`, or starts one.  If it can't be written,
+  // what's found is still remembered until the miner exits.
+  explicit SolutionCache(const std::string& path) : path_(path) { open(); }
+
+  ~SolutionCache() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  SolutionCache(const SolutionCache&) = delete;
+  SolutionCache& operator=(const SolutionCache&) = delete;
+
+  // Records in the file.
+  size_t records() const { return records_; }
+
+  // The solutions found for `challenge`, oldest first.
+  const std::vector<uint64_t>& solutions(const uint64_t challenge) const {
+    static const std::vector<uint64_t> none;
+    const auto found = solutions_.find(challenge);
+    return found == solutions_.end() ? none : found->second.values;
+  }
+
+  // How far `worker` got through its sequence of `share`, 0 if it never
+  // started.
+  uint64_t searched(const uint64_t share, const unsigned worker) const {
+    const auto found = searched_.find(share);
+    if (found == searched_.end() || worker >= found->second.values.size()) {
+      return 0;
+    }
+    return found->second.values[worker];
+  }
+
+  void add_solution(const uint64_t challenge, const uint64_t nonce) {
+    append(challenge, nonce, solution_cache_detail::SOLUTION, 0);
+  }
+
+  // Forgets a solution the server turned down, so it isn't tried again.
+  void reject_solution(const uint64_t challenge, const uint64_t nonce) {
+    append(challenge, nonce, solution_cache_detail::REJECTED, 0);
+  }
+
+  // Only written if it's further than the worker got so far.
+  void add_searched(const uint64_t share, const unsigned worker,
+                    const uint64_t position) {
+    append(share, position, solution_cache_detail::SEARCHED, worker);
+  }
+
+ private:
+  using Record = solution_cache_detail::Record;
+
+  struct Entry {
+    // Nonces for a challenge; positions by worker for a share.
+    std::vector<uint64_t> values;
+    // When it last changed, to keep the latest when compacting.
+    uint64_t changed = 0;
+  };
+  using Index = std::unordered_map<uint64_t, Entry>;
+
+  const std::string path_;
+  int fd_ = -1;
+  size_t records_ = 0;
+  // Where to compact next, past MAX_RECORDS if compacting failed.
+  size_t compact_at_ = MAX_RECORDS;
+  uint64_t changes_ = 0;
+  Index solutions_;
+  Index searched_;
+
+  void open() {
+    using solution_cache_detail::HEADER_SIZE;
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                 0644);
+    if (fd_ < 0) {
+      std::cerr << "Can't open the solution cache " << path_ << std::endl;
+      return;
+    }
+    struct stat file;
+    const size_t size = fstat(fd_, &file) == 0 ? file.st_size : 0;
+    size_t valid = 0;
+    if (size >= HEADER_SIZE) {
+      void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (map != MAP_FAILED) {
+        const char* bytes = static_cast<const char*>(map);
+        if (std::memcmp(bytes, solution_cache_detail::MAGIC,
+                        sizeof(solution_cache_detail::MAGIC)) == 0) {
+          valid = HEADER_SIZE;
+          for (; valid + sizeof(Record) <= size; valid += sizeof(Record)) {
+            Record record;
+            std::memcpy(&record, bytes + valid, sizeof(record));
+            if (!solution_cache_detail::well_formed(record)) break;
+            apply(record);
+            ++records_;
+          }
+        }
+        munmap(map, size);
+      }
+    }
+    // Anything past the last whole record is cut off, so appends line up.
+    if (valid == 0) {
+      if (ftruncate(fd_, 0) != 0 || !solution_cache_detail::write_header(fd_)) {
+        give_up("Can't write the solution cache ");
+      }
+    } else if (valid < size && ftruncate(fd_, valid) != 0) {
+      give_up("Can't repair the solution cache ");
+    }
+    if (records_ >= compact_at_) compact();
+  }
+
+  // Returns false if the record adds nothing.
+  bool apply(const Record& record) {
+    if (record.kind == solution_cache_detail::REJECTED) {
+      const auto found = solutions_.find(record.key);
+      if (found == solutions_.end()) return false;
+      auto& nonces = found->second.values;
+      const auto nonce = std::find(nonces.begin(), nonces.end(), record.value);
+      if (nonce == nonces.end()) return false;
+      nonces.erase(nonce);
+      found->second.changed = ++changes_;
+      return true;
+    }
+    if (record.kind == solution_cache_detail::SOLUTION) {
+      Entry& entry = solutions_[record.key];
+      auto& nonces = entry.values;
+      if (std::find(nonces.begin(), nonces.end(), record.value) !=
+          nonces.end()) {
+        return false;
+      }
+      nonces.push_back(record.value);
+      entry.changed = ++changes_;
+      return true;
+    }
+    Entry& entry = searched_[record.key];
+    auto& positions = entry.values;
+    if (positions.size() <= record.worker) {
+      positions.resize(record.worker + 1, 0);
+    }
+    if (positions[record.worker] >= record.value) return false;
+    positions[record.worker] = record.value;
+    entry.changed = ++changes_;
+    return true;
+  }
+
+  void append(const uint64_t key, const uint64_t value, const uint32_t kind,
+              const unsigned worker) {
+    Record record{key, value, kind, worker, 0};
+    record.checksum = solution_cache_detail::checksum(record);
+    if (!apply(record) || fd_ < 0) return;
+    if (!solution_cache_detail::write_all(fd_, &record, sizeof(record))) {
+      give_up("Can't write the solution cache ");
+      return;
+    }
+    if (++records_ >= compact_at_) compact();
+  }
+
+  // Keeps the MAX_KEPT entries of `index` changed last, as records.
+  static void keep_latest(Index& index, const uint32_t kind,
+                          std::vector<Record>& records) {
+    std::vector<std::pair<uint64_t, uint64_t>> by_change;
+    for (const auto& entry : index) {
+      by_change.emplace_back(entry.second.changed, entry.first);
+    }
+    std::sort(by_change.rbegin(), by_change.rend());
+    for (size_t i = MAX_KEPT; i < by_change.size(); ++i) {
+      index.erase(by_change[i].second);
+    }
+    for (const auto& entry : index) {
+      const auto& values = entry.second.values;
+      for (size_t i = 0; i < values.size(); ++i) {
+        if (kind == solution_cache_detail::SEARCHED && values[i] == 0) {
+          continue;
+        }
+        const unsigned worker =
+            kind == solution_cache_detail::SEARCHED ? i : 0;
+        Record record{entry.first, values[i], kind, worker, 0};
+        record.checksum = solution_cache_detail::checksum(record);
+        records.push_back(record);
+      }
+    }
+  }
+
+  // Written next to the cache and renamed over it, so a crash leaves either
+  // the old file or the new one.
+  void compact() {
+    std::vector<Record> records;
+    keep_latest(solutions_, solution_cache_detail::SOLUTION, records);
+    keep_latest(searched_, solution_cache_detail::SEARCHED, records);
+
+    const std::string temporary = path_ + ".tmp";
+    const int fd = ::open(temporary.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0 && solution_cache_detail::write_header(fd) &&
+                   solution_cache_detail::write_all(
+                       fd, records.data(), records.size() * sizeof(Record));
+    if (fd >= 0) written = ::close(fd) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), path_.c_str()) != 0) {
+      std::cerr << "Can't compact the solution cache " << path_ << std::endl;
+      compact_at_ = records_ + MAX_RECORDS;
+      return;
+    }
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd_ < 0) give_up("Can't reopen the solution cache ");
+    records_ = records.size();
+    compact_at_ = MAX_RECORDS;
+  }
+
+  // Keeps going in memory only.
+  void give_up(const char* message) {
+    std::cerr << message << path_ << std::endl;
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+  }
+};
+
+#endif /* SOLUTION_CACHE_H */
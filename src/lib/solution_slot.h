@@ -0,0 +1,77 @@
+#ifndef SOLUTION_SLOT_H
+#define SOLUTION_SLOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+// Hands the nonces solving a challenge from the solvers over to the thread
+// talking to the server.  Every challenge gets an epoch from open(), and the
+// solvers working on it tag what they offer with it, so a nonce found for a
+// challenge that has since been replaced is never taken.
+//
+// open() and take() belong to one consumer thread; any number of solvers may
+// offer().  The first MAX_CANDIDATES nonces offered for an epoch are kept in
+// order, so there's another to submit if the first is rejected or lost, and
+// each one calls `on_solution` so the consumer can be woken up instead of
+// polling.  Solutions are rare enough for a lock; offers for a replaced
+// challenge don't even take it.
+class SolutionSlot {
+ public:
+  static constexpr size_t MAX_CANDIDATES = 16;
+
+  explicit SolutionSlot(std::function<void()> on_solution = nullptr)
+      : on_solution_(std::move(on_solution)) {}
+  SolutionSlot(const SolutionSlot&) = delete;
+  SolutionSlot& operator=(const SolutionSlot&) = delete;
+
+  // Starts a new challenge and returns its epoch.  Nothing offered for an
+  // earlier epoch can be taken after this.
+  uint64_t open() {
+    std::lock_guard<std::mutex> lock(mu_);
+    const uint64_t epoch = current_.load(std::memory_order_relaxed) + 1;
+    current_.store(epoch, std::memory_order_relaxed);
+    offered_ = 0;
+    taken_ = 0;
+    return epoch;
+  }
+
+  // Returns true if `nonce` was kept as a candidate for `epoch`.
+  bool offer(const uint64_t epoch, const uint64_t nonce) {
+    if (epoch != current_.load(std::memory_order_relaxed)) return false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (epoch != current_.load(std::memory_order_relaxed) ||
+          offered_ == MAX_CANDIDATES) {
+        return false;
+      }
+      candidates_[offered_++] = nonce;
+    }
+    if (on_solution_) on_solution_();
+    return true;
+  }
+
+  // Takes the oldest candidate of the current epoch not taken yet.  Returns
+  // false if there's none.
+  bool take(uint64_t& nonce) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (taken_ == offered_) return false;
+    nonce = candidates_[taken_++];
+    return true;
+  }
+
+ private:
+  std::function<void()> on_solution_;
+  std::mutex mu_;
+  // Only written under the lock, but read without it to turn stale offers
+  // away early.
+  std::atomic<uint64_t> current_{0};
+  uint64_t candidates_[MAX_CANDIDATES];
+  size_t offered_ = 0;
+  size_t taken_ = 0;
+};
+
+#endif /* SOLUTION_SLOT_H */
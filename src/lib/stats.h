@@ -0,0 +1,213 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Build with -DDANGMINER_STATS=0 to compile every counter and timer below
+// down to nothing.
+#ifndef DANGMINER_STATS
+#define DANGMINER_STATS 1
+#endif
+
+// What the workers are doing: attempts, shortest path grids without a path,
+// and where an attempt's time goes, phase by phase.  Every worker thread
+// counts into cache lines of its own with plain relaxed stores, and
+// snapshot() adds them all up.
+namespace stats {
+
+constexpr bool ENABLED = DANGMINER_STATS != 0;
+
+enum Phase {
+  SEED,
+  GENERATE,
+  SORT,
+  SEARCH,
+  SERIALIZE,
+  HASH,
+  CHECK,
+  N_PHASES,
+};
+
+constexpr const char* PHASE_NAMES[N_PHASES] = {
+    "seed", "generate", "sort", "search", "serialize", "hash", "check"};
+
+// Worker threads counting at once.  Any more share one set of counters and
+// may lose counts.
+constexpr size_t MAX_WORKERS = 256;
+
+// The time stamp counter on x86, nanoseconds elsewhere.
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+struct Snapshot {
+  uint64_t attempts = 0;
+  uint64_t no_path = 0;
+  uint64_t phase_ticks[N_PHASES] = {};
+  std::chrono::steady_clock::time_point taken_at;
+  uint64_t ticks_at = 0;
+};
+
+#if DANGMINER_STATS
+
+namespace detail {
+
+struct alignas(64) Counters {
+  std::atomic<uint64_t> attempts;
+  std::atomic<uint64_t> no_path;
+  std::atomic<uint64_t> phase_ticks[N_PHASES];
+  bool in_use;
+};
+
+// Only ever written by the thread holding it, so no read-modify-write.
+inline void add(std::atomic<uint64_t>& counter, const uint64_t n) {
+  counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+}
+
+inline uint64_t read(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+inline void add_to(Snapshot& total, const Counters& counters) {
+  total.attempts += read(counters.attempts);
+  total.no_path += read(counters.no_path);
+  for (int phase = 0; phase < N_PHASES; ++phase) {
+    total.phase_ticks[phase] += read(counters.phase_ticks[phase]);
+  }
+}
+
+class Registry {
+ public:
+  static Registry& get() {
+    static Registry registry;
+    return registry;
+  }
+
+  Counters& acquire() {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (auto& counters : counters_) {
+      if (!counters.in_use) {
+        counters.in_use = true;
+        return counters;
+      }
+    }
+    return overflow_;
+  }
+
+  // Folds a thread's counts into the totals once it exits, so they don't
+  // go backwards.
+  void release(Counters& counters) {
+    if (&counters == &overflow_) return;
+    std::lock_guard<std::mutex> lock(mu_);
+    add_to(retired_, counters);
+    counters.attempts.store(0, std::memory_order_relaxed);
+    counters.no_path.store(0, std::memory_order_relaxed);
+    for (auto& phase : counters.phase_ticks) {
+      phase.store(0, std::memory_order_relaxed);
+    }
+    counters.in_use = false;
+  }
+
+  Snapshot snapshot() {
+    std::lock_guard<std::mutex> lock(mu_);
+    Snapshot total = retired_;
+    for (const auto& counters : counters_) {
+      if (counters.in_use) add_to(total, counters);
+    }
+    add_to(total, overflow_);
+    total.taken_at = std::chrono::steady_clock::now();
+    total.ticks_at = ticks();
+    return total;
+  }
+
+ private:
+  std::mutex mu_;
+  Counters counters_[MAX_WORKERS] = {};
+  Counters overflow_ = {};
+  Snapshot retired_;
+};
+
+// The calling thread's counters, for as long as it lives.
+class Lease {
+ public:
+  Lease() : counters_(Registry::get().acquire()) {}
+  ~Lease() { Registry::get().release(counters_); }
+  Counters& counters() { return counters_; }
+
+ private:
+  Counters& counters_;
+};
+
+inline Counters& local() {
+  static thread_local Lease lease;
+  return lease.counters();
+}
+
+}  // namespace detail
+
+// Times the phases of a solver's attempts: each lap() charges the time since
+// the previous one to a phase.  About 20 cycles a lap.
+class AttemptTimer {
+ public:
+  AttemptTimer() : counters_(detail::local()), last_(ticks()) {}
+
+  void lap(const Phase phase) {
+    const uint64_t now = ticks();
+    detail::add(counters_.phase_ticks[phase], now - last_);
+    last_ = now;
+  }
+
+  void attempt() { detail::add(counters_.attempts, 1); }
+  void no_path() { detail::add(counters_.no_path, 1); }
+
+ private:
+  detail::Counters& counters_;
+  uint64_t last_;
+};
+
+inline Snapshot snapshot() { return detail::Registry::get().snapshot(); }
+
+#else
+
+class AttemptTimer {
+ public:
+  void lap(Phase) {}
+  void attempt() {}
+  void no_path() {}
+};
+
+inline Snapshot snapshot() {
+  Snapshot empty;
+  empty.taken_at = std::chrono::steady_clock::now();
+  return empty;
+}
+
+#endif
+
+// Nanoseconds per tick between two snapshots.
+inline double ns_per_tick(const Snapshot& from, const Snapshot& to) {
+  const std::chrono::duration<double, std::nano> elapsed =
+      to.taken_at - from.taken_at;
+  const uint64_t ticks = to.ticks_at - from.ticks_at;
+  return ticks == 0 ? 0 : elapsed.count() / ticks;
+}
+
+}  // namespace stats
+
+#endif /* STATS_H */
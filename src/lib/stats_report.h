@@ -0,0 +1,118 @@
+#ifndef STATS_REPORT_H
+#define STATS_REPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "stats.h"
+
+// The counters of stats.h as a log line or as JSON.
+namespace stats {
+
+namespace detail {
+
+inline double seconds_between(const Snapshot& from, const Snapshot& to) {
+  const std::chrono::duration<double> elapsed = to.taken_at - from.taken_at;
+  return elapsed.count();
+}
+
+inline double per_second(const uint64_t count, const double seconds) {
+  return seconds > 0 ? count / seconds : 0;
+}
+
+// Average nanoseconds `phase` took per attempt between the two snapshots.
+inline double phase_ns(const Snapshot& from, const Snapshot& to,
+                       const int phase, const double ns_per_tick) {
+  const uint64_t attempts = to.attempts - from.attempts;
+  if (attempts == 0) return 0;
+  return (to.phase_ticks[phase] - from.phase_ticks[phase]) * ns_per_tick /
+         attempts;
+}
+
+inline uint64_t all_phase_ticks(const Snapshot& s) {
+  uint64_t total = 0;
+  for (const uint64_t t : s.phase_ticks) total += t;
+  return total;
+}
+
+}  // namespace detail
+
+// "Stats: 72804 attempts/s, 12 grids without a path/s; seed 180 ns (13%),
+// ..." between `from` and `to`.
+inline std::string log_line(const Snapshot& from, const Snapshot& to) {
+  const double seconds = detail::seconds_between(from, to);
+  std::ostringstream line;
+  line.precision(0);
+  line << std::fixed << "Stats: "
+       << detail::per_second(to.attempts - from.attempts, seconds)
+       << " attempts/s, "
+       << detail::per_second(to.no_path - from.no_path, seconds)
+       << " grids without a path/s";
+  const double tick_ns = ns_per_tick(from, to);
+  const uint64_t total_ticks =
+      detail::all_phase_ticks(to) - detail::all_phase_ticks(from);
+  if (total_ticks == 0) return line.str();
+
+  line << ";";
+  for (int phase = 0; phase < N_PHASES; ++phase) {
+    const uint64_t ticks = to.phase_ticks[phase] - from.phase_ticks[phase];
+    if (ticks == 0) continue;
+    line << ' ' << PHASE_NAMES[phase] << ' '
+         << detail::phase_ns(from, to, phase, tick_ns) << " ns ("
+         << 100.0 * ticks / total_ticks << "%)";
+  }
+  return line.str();
+}
+
+// Totals since `start`, and rates and where an attempt's time went between
+// `previous` and `now`.
+inline std::string to_json(const Snapshot& start, const Snapshot& previous,
+                           const Snapshot& now) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("enabled");
+  writer.Bool(ENABLED);
+  writer.Key("seconds");
+  writer.Double(detail::seconds_between(start, now));
+  writer.Key("attempts");
+  writer.Uint64(now.attempts - start.attempts);
+  writer.Key("no_path");
+  writer.Uint64(now.no_path - start.no_path);
+
+  const double seconds = detail::seconds_between(previous, now);
+  writer.Key("interval_seconds");
+  writer.Double(seconds);
+  writer.Key("attempts_per_second");
+  writer.Double(detail::per_second(now.attempts - previous.attempts, seconds));
+  writer.Key("no_path_per_second");
+  writer.Double(detail::per_second(now.no_path - previous.no_path, seconds));
+
+  const double tick_ns = ns_per_tick(start, now);
+  const uint64_t total_ticks =
+      detail::all_phase_ticks(now) - detail::all_phase_ticks(previous);
+  writer.Key("phases");
+  writer.StartObject();
+  for (int phase = 0; phase < N_PHASES; ++phase) {
+    const uint64_t ticks = now.phase_ticks[phase] - previous.phase_ticks[phase];
+    writer.Key(PHASE_NAMES[phase]);
+    writer.StartObject();
+    writer.Key("ns_per_attempt");
+    writer.Double(detail::phase_ns(previous, now, phase, tick_ns));
+    writer.Key("share");
+    writer.Double(total_ticks == 0 ? 0 : double(ticks) / total_ticks);
+    writer.EndObject();
+  }
+  writer.EndObject();
+  writer.EndObject();
+  return buffer.GetString();
+}
+
+}  // namespace stats
+
+#endif /* STATS_REPORT_H */
@@ -1,13 +1,281 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <future>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "cpu_topology.h"
 
 namespace qp {
 namespace threading {
 
+// Bytes of inline storage per task.  A task is the callable plus copies of
+// its arguments, exactly like std::bind would store them.
+constexpr size_t TASK_STORAGE_SIZE = 256;
+
+namespace detail {
+
+template <typename F, typename... Args>
+class BoundCall {
+ public:
+  template <typename G, typename... CallArgs>
+  explicit BoundCall(G&& f, CallArgs&&... args)
+      : f_(std::forward<G>(f)), args_(std::forward<CallArgs>(args)...) {}
+
+  void operator()() { call(std::index_sequence_for<Args...>()); }
+
+ private:
+  F f_;
+  std::tuple<Args...> args_;
+
+  // Arguments are passed as lvalues, and std::reference_wrapper converts to
+  // the reference it holds, so std::ref/std::cref work like with std::bind.
+  template <size_t... I>
+  void call(std::index_sequence<I...>) {
+    f_(std::get<I>(args_)...);
+  }
+};
+
+// A type erased void() callable stored inline.  run() calls it once and
+// destroys it.
+class Task {
+ public:
+  template <typename F, typename... Args>
+  void emplace(F&& f, Args&&... args) {
+    using Callable = BoundCall<std::decay_t<F>, std::decay_t<Args>...>;
+    static_assert(sizeof(Callable) <= TASK_STORAGE_SIZE,
+                  "Task too big for inline storage; pass big arguments with "
+                  "std::cref.");
+    static_assert(alignof(Callable) <= alignof(std::max_align_t),
+                  "Task arguments are over-aligned.");
+    new (storage_) Callable(std::forward<F>(f), std::forward<Args>(args)...);
+    run_ = [](void* p) {
+      auto* callable = static_cast<Callable*>(p);
+      (*callable)();
+      callable->~Callable();
+    };
+  }
+
+  void run() { run_(storage_); }
+
+ private:
+  alignas(std::max_align_t) unsigned char storage_[TASK_STORAGE_SIZE];
+  void (*run_)(void*);
+};
+
+// The smallest power of two that is at least n, and at least 1.
+inline size_t round_up_to_power_of_two(const size_t n) {
+  size_t power = 1;
+  while (power < n) power *= 2;
+  return power;
+}
+
+// Bounded multi-producer multi-consumer queue of task slot indices (Dmitry
+// Vyukov's design).  Used both for tasks submitted from outside the pool and
+// as the free list of task slots.  The capacity must be a power of two, and
+// the queue must never hold more than that; there are only as many indices
+// as cells, so it can't.  Unlike the original, push waits out a pop of its
+// cell that is still in progress instead of reporting the queue full, and pop
+// only reports empty when it really is.
+class IndexQueue {
+ public:
+  explicit IndexQueue(const size_t capacity)
+      : mask_(capacity - 1), cells_(new Cell[capacity]) {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  void push(const uint32_t value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return;
+        }
+      } else if (diff < 0) {
+        // The last pop of this cell hasn't finished.
+        std::this_thread::yield();
+        pos = tail_.load(std::memory_order_relaxed);
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(uint32_t& value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = intptr_t(sequence) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          value = cell.value;
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        if (tail_.load(std::memory_order_relaxed) == pos) return false;
+        // The push of this cell hasn't finished.
+        std::this_thread::yield();
+        pos = head_.load(std::memory_order_relaxed);
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    uint32_t value;
+  };
+
+  // The ends are padded apart so producers and consumers don't fight over
+  // one cache line.
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  std::atomic<size_t> head_{0};
+  char head_padding_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_{0};
+};
+
+// Chase-Lev work stealing deque of task slot indices, with the memory
+// orderings from Le et al., "Correct and Efficient Work-Stealing for Weak
+// Memory Models".  Only the owning worker pushes and takes from the bottom;
+// anyone may steal from the top.  It never needs to grow since there are
+// never more tasks than task slots.
+class WorkDeque {
+ public:
+  static constexpr uint32_t EMPTY = ~uint32_t(0);
+
+  explicit WorkDeque(const size_t capacity)
+      : mask_(capacity - 1), slots_(new std::atomic<uint32_t>[capacity]) {}
+
+  void push(const uint32_t value) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    slots_[b & mask_].store(value, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  uint32_t take() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+
+    uint32_t value = EMPTY;
+    if (t <= b) {
+      value = slots_[b & mask_].load(std::memory_order_relaxed);
+      if (t == b) {
+        // Last one; race the thieves for it.
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+          value = EMPTY;
+        }
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return value;
+  }
+
+  uint32_t steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return EMPTY;
+
+    const uint32_t value = slots_[t & mask_].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return EMPTY;  // Lost the race; the caller moves on to someone else.
+    }
+    return value;
+  }
+
+ private:
+  const size_t mask_;
+  std::unique_ptr<std::atomic<uint32_t>[]> slots_;
+  std::atomic<int64_t> top_{0};
+  char top_padding_[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom_{0};
+};
+
+}  // namespace detail
+
+class Threadpool;
+
+// A set of tasks that are waited on and cancelled together.  Tasks see the
+// cancellation through token().
+class TaskGroup {
+ public:
+  TaskGroup() : pending_(0) {}
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  const CancellationToken& token() const { return token_; }
+
+  void cancel() { token_.cancel(); }
+
+  // Blocks until every task added to the group has finished.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mu_);
+    done_.wait(lock, [this] { return pending_.load() == 0; });
+  }
+
+  // Cancels and waits for every task, then resets the token so the group can
+  // be reused.
+  void cancel_and_wait() {
+    cancel();
+    wait();
+    token_.reset();
+  }
+
+ private:
+  friend class Threadpool;
+
+  std::atomic<int> pending_;
+  std::mutex mu_;
+  std::condition_variable done_;
+  CancellationToken token_;
+
+  void started() { pending_.fetch_add(1); }
+
+  // Under the lock, so a waiter can't return and destroy the group while
+  // this is still touching it.
+  void finished() {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (pending_.fetch_sub(1) == 1) done_.notify_all();
+  }
+};
+
+// Work stealing thread pool.  Every worker owns a lock-free deque; tasks
+// added from a worker go to its own deque, tasks added from anywhere else go
+// through a shared lock-free queue, and idle workers steal from each other.
+// Tasks live in preallocated slots, so adding one never allocates.
 class Threadpool {
  public:
   // Starts a thread pool with the number of threads available on the machine.
@@ -15,78 +283,176 @@ class Threadpool {
 
   // Starts a thread pool with the specified number of threads.  Be careful as
   // creating too many threads will have adverse performance benefits.
-  Threadpool(int n_threads);
+  // `max_tasks` bounds how many tasks can be queued at once.  It's rounded up
+  // to a power of two, which the queues index with a mask.
+  explicit Threadpool(int n_threads, size_t max_tasks = 1024);
+
+  // Starts one thread per entry of `cpus`, each pinned to that CPU, so it
+  // keeps its caches and the memory it touches first is on its NUMA node.
+  explicit Threadpool(const std::vector<int>& cpus, size_t max_tasks = 1024);
 
-  // Add work to the queue.  Returns a future contain the results.
+  // Queues f(args...) as part of `group`.  Arguments are copied into the task
+  // like std::bind does.  If every task slot is in use, f runs right away on
+  // the calling thread instead.
   template <typename F, typename... Args>
-  auto add(F&& f, Args&&... args) ->
-      typename std::future<typename std::result_of<F(Args...)>::type>;
+  void add(TaskGroup& group, F&& f, Args&&... args);
 
-  // Shuts down the threadpool.  All tasks currently being executed will finish
-  // and all threads will be joined.  All tasks still in the queue will be
-  // aborted, and their futures will be invalidated.
+  // Finishes every task still queued, then joins all threads.
   ~Threadpool();
 
  private:
+  struct Slot {
+    detail::Task task;
+    TaskGroup* group;
+  };
+
+  struct WorkerIdentity {
+    Threadpool* pool;
+    size_t index;
+  };
+
+  const size_t max_tasks_;
+  std::unique_ptr<Slot[]> slots_;
+  detail::IndexQueue free_slots_;
+  detail::IndexQueue injected_;
+  std::vector<std::unique_ptr<detail::WorkDeque>> deques_;
   std::vector<std::thread> threads_;
-  bool shutdown_ = false;
-  std::queue<std::function<void()>> work_queue_;
-  std::mutex mu_;
-  std::condition_variable work_added_;
+  // CPU of each thread, or empty if they aren't pinned.
+  const std::vector<int> cpus_;
+
+  // Tasks added but not yet picked up by a worker.
+  std::atomic<size_t> queued_{0};
+  std::atomic<bool> shutdown_{false};
+
+  // Idle workers sleep here.  Adders only touch the mutex when someone is
+  // actually asleep.
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<int> sleepers_{0};
+  std::mutex park_mu_;
+  std::condition_variable park_cv_;
+
+  static WorkerIdentity& current_worker() {
+    static thread_local WorkerIdentity identity{nullptr, 0};
+    return identity;
+  }
+
+  void run_slot(const uint32_t index) {
+    Slot& slot = slots_[index];
+    TaskGroup* group = slot.group;
+    slot.task.run();
+    free_slots_.push(index);
+    group->finished();
+  }
+
+  uint32_t find_work(const size_t self) {
+    uint32_t index = deques_[self]->take();
+    if (index != detail::WorkDeque::EMPTY) return index;
+    if (injected_.pop(index)) return index;
+    for (size_t i = 1; i < deques_.size(); ++i) {
+      index = deques_[(self + i) % deques_.size()]->steal();
+      if (index != detail::WorkDeque::EMPTY) return index;
+    }
+    return detail::WorkDeque::EMPTY;
+  }
+
+  void wake_one() {
+    epoch_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+      std::lock_guard<std::mutex> lock(park_mu_);
+      park_cv_.notify_one();
+    }
+  }
+
+  void park() {
+    sleepers_.fetch_add(1);
+    const uint64_t epoch = epoch_.load();
+    if (queued_.load() == 0 && !shutdown_.load()) {
+      std::unique_lock<std::mutex> lock(park_mu_);
+      park_cv_.wait(lock, [&] {
+        return epoch_.load() != epoch || shutdown_.load();
+      });
+    }
+    sleepers_.fetch_sub(1);
+  }
+
+  Threadpool(int n_threads, size_t max_tasks, const std::vector<int>& cpus);
 
   // Worker function which actually carries out the tasks.
-  void worker();
+  void worker(size_t self);
 };
 
-Threadpool::Threadpool(int n_threads) {
+Threadpool::Threadpool(int n_threads, const size_t max_tasks)
+    : Threadpool(n_threads, max_tasks, std::vector<int>()) {}
+
+Threadpool::Threadpool(const std::vector<int>& cpus, const size_t max_tasks)
+    : Threadpool(cpus.size(), max_tasks, cpus) {}
+
+Threadpool::Threadpool(int n_threads, const size_t max_tasks,
+                       const std::vector<int>& cpus)
+    : max_tasks_(detail::round_up_to_power_of_two(max_tasks)),
+      slots_(new Slot[max_tasks_]),
+      free_slots_(max_tasks_),
+      injected_(max_tasks_),
+      cpus_(cpus) {
+  n_threads = std::max(n_threads, 1);
+  for (size_t i = 0; i < max_tasks_; ++i) free_slots_.push(i);
+  for (int i = 0; i < n_threads; ++i) {
+    deques_.emplace_back(new detail::WorkDeque(max_tasks_));
+  }
   for (int i = 0; i < n_threads; ++i) {
-    threads_.emplace_back(&Threadpool::worker, this);
+    threads_.emplace_back(&Threadpool::worker, this, i);
   }
 }
 
 template <typename F, typename... Args>
-auto Threadpool::add(F&& f, Args&&... args) ->
-    typename std::future<typename std::result_of<F(Args...)>::type> {
-  using ReturnType = typename std::result_of<F(Args...)>::type;
+void Threadpool::add(TaskGroup& group, F&& f, Args&&... args) {
+  group.started();
 
-  auto work = std::make_shared<std::packaged_task<ReturnType()>>(
-      std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+  uint32_t index;
+  if (!free_slots_.pop(index)) {
+    detail::Task task;
+    task.emplace(std::forward<F>(f), std::forward<Args>(args)...);
+    task.run();
+    group.finished();
+    return;
+  }
 
-  std::future<ReturnType> ret = work->get_future();
+  Slot& slot = slots_[index];
+  slot.task.emplace(std::forward<F>(f), std::forward<Args>(args)...);
+  slot.group = &group;
 
-  {
-    std::lock_guard<std::mutex> lock(mu_);
-    work_queue_.emplace([work]() { (*work)(); });
+  queued_.fetch_add(1);
+  const WorkerIdentity& self = current_worker();
+  if (self.pool == this) {
+    deques_[self.index]->push(index);
+  } else {
+    injected_.push(index);
   }
-
-  work_added_.notify_one();
-  return ret;
+  wake_one();
 }
 
-void Threadpool::worker() {
+void Threadpool::worker(const size_t self) {
+  current_worker() = WorkerIdentity{this, self};
+  if (self < cpus_.size()) cpu_topology::pin_current_thread({cpus_[self]});
   while (true) {
-    std::function<void()> work;
-
-    {
-      std::unique_lock<std::mutex> lock(mu_);
-      work_added_.wait(lock,
-                       [this] { return shutdown_ || !work_queue_.empty(); });
-      if (shutdown_) return;
-
-      work = std::move(work_queue_.front());
-      work_queue_.pop();
+    const uint32_t index = find_work(self);
+    if (index != detail::WorkDeque::EMPTY) {
+      queued_.fetch_sub(1);
+      run_slot(index);
+      continue;
     }
 
-    work();
+    if (shutdown_.load() && queued_.load() == 0) return;
+    park();
   }
 }
 
 Threadpool::~Threadpool() {
-  mu_.lock();
-  shutdown_ = true;
-  mu_.unlock();
-
-  work_added_.notify_all();
+  shutdown_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(park_mu_);
+    park_cv_.notify_all();
+  }
   for (auto& thread : threads_) {
     thread.join();
   }
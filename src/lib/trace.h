@@ -0,0 +1,269 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+// A timeline of what the miner did, for when the stats say it got slower
+// but not why: challenges coming in, workers waiting for and working on
+// them, every SAMPLE_EVERY-th attempt phase by phase, solutions found and
+// submitted.  Off unless enable() is called; until then recording an event
+// costs a relaxed load.
+//
+// Every thread records into a ring of its own, which keeps the last
+// RING_EVENTS events, and dump() writes them all out in the Chrome trace
+// event format, for chrome://tracing or ui.perfetto.dev.
+namespace trace {
+
+constexpr size_t RING_EVENTS = size_t(1) << 16;
+constexpr unsigned SAMPLE_EVERY = 1024;
+
+struct Event {
+  // String literals, so recording never copies or allocates.
+  const char* name;
+  // Null if the event has no argument.
+  const char* arg_name;
+  uint64_t arg;
+  uint64_t begin;
+  uint64_t end;
+  bool instant;
+};
+
+namespace detail {
+
+// Written by its thread alone and read by dump(), which skips what the
+// writer may be overwriting.
+class Ring {
+ public:
+  explicit Ring(const unsigned tid)
+      : tid_(tid), events_(new Event[RING_EVENTS]) {}
+
+  unsigned tid() const { return tid_; }
+
+  void push(const Event& event) {
+    const uint64_t n = written_.load(std::memory_order_relaxed);
+    events_[n % RING_EVENTS] = event;
+    written_.store(n + 1, std::memory_order_release);
+  }
+
+  // The events still in the ring, oldest first.
+  std::vector<Event> events() const {
+    const uint64_t end = written_.load(std::memory_order_acquire);
+    const uint64_t begin = end > RING_EVENTS ? end - RING_EVENTS : 0;
+    std::vector<Event> copy;
+    copy.reserve(end - begin);
+    for (uint64_t i = begin; i < end; ++i) {
+      copy.push_back(events_[i % RING_EVENTS]);
+    }
+    // Drops the ones the writer got to meanwhile, and the one it may be
+    // writing now.
+    const uint64_t after = written_.load(std::memory_order_acquire) + 1;
+    if (after > begin + RING_EVENTS) {
+      const size_t lapped =
+          std::min<uint64_t>(after - RING_EVENTS - begin, copy.size());
+      copy.erase(copy.begin(), copy.begin() + lapped);
+    }
+    return copy;
+  }
+
+  std::string name;
+
+ private:
+  const unsigned tid_;
+  std::unique_ptr<Event[]> events_;
+  std::atomic<uint64_t> written_{0};
+};
+
+struct State {
+  std::atomic<bool> enabled{false};
+  std::mutex mu;
+  // Kept past the threads' exit, so their events are still dumped.
+  std::vector<std::shared_ptr<Ring>> rings;
+  std::chrono::steady_clock::time_point enabled_at;
+  uint64_t enabled_ticks = 0;
+};
+
+inline State& state() {
+  static State state;
+  return state;
+}
+
+// The calling thread's ring, made the first time it records something.
+inline Ring& local() {
+  static thread_local std::shared_ptr<Ring> ring;
+  if (!ring) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mu);
+    ring = std::make_shared<Ring>(s.rings.size() + 1);
+    s.rings.push_back(ring);
+  }
+  return *ring;
+}
+
+inline void write_event(std::ostream& out, const Event& event,
+                        const unsigned tid, const uint64_t start_ticks,
+                        const double ns_per_tick) {
+  // Microseconds since enable().
+  const double ts = int64_t(event.begin - start_ticks) * ns_per_tick / 1000;
+  out << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << tid
+      << ",\"ts\":" << ts;
+  if (event.instant) {
+    out << ",\"ph\":\"i\",\"s\":\"t\"";
+  } else {
+    out << ",\"ph\":\"X\",\"dur\":"
+        << (event.end - event.begin) * ns_per_tick / 1000;
+  }
+  if (event.arg_name != nullptr) {
+    out << ",\"args\":{\"" << event.arg_name << "\":" << event.arg << "}";
+  }
+  out << "}";
+}
+
+}  // namespace detail
+
+inline bool enabled() {
+  return detail::state().enabled.load(std::memory_order_relaxed);
+}
+
+// Starts recording.  Call it before starting the threads to trace, so they
+// can name themselves.
+inline void enable() {
+  detail::State& s = detail::state();
+  s.enabled_at = std::chrono::steady_clock::now();
+  s.enabled_ticks = stats::ticks();
+  s.enabled.store(true, std::memory_order_relaxed);
+}
+
+// Names the calling thread's track in the trace.
+inline void name_thread(const std::string& name) {
+  if (!enabled()) return;
+  detail::Ring& ring = detail::local();
+  std::lock_guard<std::mutex> lock(detail::state().mu);
+  ring.name = name;
+}
+
+// Something that happened at one point in time.
+inline void instant(const char* name, const char* arg_name = nullptr,
+                    const uint64_t arg = 0) {
+  if (!enabled()) return;
+  const uint64_t now = stats::ticks();
+  detail::local().push(Event{name, arg_name, arg, now, now, true});
+}
+
+// Records the time from its construction to its destruction.
+class Span {
+ public:
+  explicit Span(const char* name, const char* arg_name = nullptr,
+                const uint64_t arg = 0)
+      : recording_(enabled()),
+        event_{name, arg_name, arg, recording_ ? stats::ticks() : 0, 0,
+               false} {}
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  ~Span() {
+    if (!recording_) return;
+    event_.end = stats::ticks();
+    detail::local().push(event_);
+  }
+
+  // For arguments only known once the span is under way.
+  void set_arg(const char* arg_name, const uint64_t arg) {
+    event_.arg_name = arg_name;
+    event_.arg = arg;
+  }
+
+ private:
+  const bool recording_;
+  Event event_;
+};
+
+// stats::AttemptTimer that also records every SAMPLE_EVERY-th attempt, and
+// each of its phases, as spans.  Between samples it costs a branch a lap.
+class AttemptTimer {
+ public:
+  void lap(const stats::Phase phase) {
+    stats_.lap(phase);
+    if (sampled_) {
+      const uint64_t now = stats::ticks();
+      detail::local().push(
+          Event{stats::PHASE_NAMES[phase], nullptr, 0, last_, now, false});
+      last_ = now;
+    }
+  }
+
+  void attempt() {
+    stats_.attempt();
+    if (sampled_) {
+      detail::local().push(
+          Event{"attempt", nullptr, 0, attempt_begin_, last_, false});
+      sampled_ = false;
+    }
+    if (--countdown_ == 0) {
+      countdown_ = SAMPLE_EVERY;
+      sampled_ = enabled();
+      last_ = attempt_begin_ = stats::ticks();
+    }
+  }
+
+  void no_path() { stats_.no_path(); }
+
+ private:
+  stats::AttemptTimer stats_;
+  unsigned countdown_ = SAMPLE_EVERY;
+  bool sampled_ = false;
+  uint64_t attempt_begin_ = 0;
+  uint64_t last_ = 0;
+};
+
+// Writes every thread's events to `path` as a Chrome trace.  Safe to call
+// while they keep recording.  Returns false if the file can't be written.
+inline bool dump(const std::string& path) {
+  detail::State& s = detail::state();
+  std::vector<std::shared_ptr<detail::Ring>> rings;
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(s.mu);
+    rings = s.rings;
+    for (const auto& ring : rings) names.push_back(ring->name);
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - s.enabled_at;
+  const uint64_t ticks = stats::ticks() - s.enabled_ticks;
+  const double ns_per_tick = ticks == 0 ? 0 : elapsed.count() / ticks;
+
+  std::ofstream out(path);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (size_t i = 0; i < rings.size(); ++i) {
+    const unsigned tid = rings[i]->tid();
+    if (!names[i].empty()) {
+      out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+          << "\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\""
+          << names[i] << "\"}}";
+      first = false;
+    }
+    for (const Event& event : rings[i]->events()) {
+      out << (first ? "" : ",") << "\n";
+      detail::write_event(out, event, tid, s.enabled_ticks, ns_per_tick);
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+  return bool(out);
+}
+
+}  // namespace trace
+
+#endif /* TRACE_H */
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -9,184 +15,568 @@
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 
+#include "challenge_feed.h"
+#include "cpu_topology.h"
+#include "cscoins_messages.h"
 #include "cscoins_wallet.h"
-#include "guarded_value.h"
+#include "solution_cache.h"
+#include "solution_slot.h"
+#include "stats.h"
+#include "stats_report.h"
 #include "threadpool.h"
+#include "trace.h"
 
-#include "shortest_path.h"
-#include "sorted_list.h"
+#include "autotune.h"
+#include "huge_pages.h"
+#include "nonce_space.h"
+#include "prefix_matcher.h"
+#include "solver_registry.h"
 
 using namespace rapidjson;
-using JobHandle = std::future<void>;
+using namespace cscoins_messages;
 
-Document parse_json(const std::string& message) {
-  Document d;
-  d.Parse(message.data());
-  return d;
+// Returns an empty Solve for challenges we can't solve.  Every worker tries
+// its own share of `nonce_space`, and records how far it got in `coverage`.
+Challenge::Solve make_solver(const ChallengeDescriptor& challenge,
+                             const Value& parameters, SolutionSlot& solutions,
+                             const uint64_t epoch,
+                             const NonceSpace& nonce_space,
+                             std::shared_ptr<NonceCoverage> coverage) {
+  // Shared by every worker through the closure below.
+  const SeedHasher seed_hasher(challenge.last_solution_hash);
+
+  Challenge::Solve solve;
+  const bool supported = Solvers::with_solver(
+      challenge.name, parameters, nonce_space.workers(),
+      [&](const auto& solver) {
+        with_prefix_matcher(challenge.hash_prefix, [&](const auto& matcher) {
+          // Intentional copy.
+          solve = [=, &solutions](const CancellationToken& superseded,
+                                  const unsigned worker) {
+            NonceCursor nonces(nonce_space.sequence(worker),
+                               coverage->resume(worker),
+                               coverage->progress(worker));
+            const uint64_t start = nonces.position();
+            solver(seed_hasher, matcher, superseded, solutions, epoch,
+                   nonces, worker);
+            coverage->record(worker, start, nonces.position());
+          };
+        });
+      });
+  if (!supported) {
+    std::cerr << "Unsupported challenge type: " << challenge.name << std::endl;
+  }
+  return solve;
 }
 
-bool is_challenge_message(const Document& d) {
-  return d.HasMember("challenge_name");
+// The challenge's key in the solution cache: the same id with other
+// parameters is another challenge as far as it goes.
+uint64_t challenge_key(const ChallengeDescriptor& challenge,
+                       const Value& parameters) {
+  StringBuffer buffer;
+  Writer<StringBuffer> writer(buffer);
+  parameters.Accept(writer);
+  return SolutionCache::key(std::to_string(challenge.id) + '\n' +
+                            challenge.name + '\n' +
+                            challenge.last_solution_hash + '\n' +
+                            challenge.hash_prefix + '\n' +
+                            buffer.GetString());
 }
 
-template <typename Comparator>
-std::vector<JobHandle> start_sorted_list_jobs(const Document& message,
-                                              qp::threading::Threadpool& pool,
-                                              const std::atomic<bool>& stop,
-                                              GuardedValue<uint64_t>& nonce) {
-  const std::string& last_solution_hash =
-      message["last_solution_hash"].GetString();
-  const std::string& hash_prefix = message["hash_prefix"].GetString();
-  const int n_elements = message["parameters"]["nb_elements"].GetInt();
-
-  std::vector<JobHandle> handles;
-  // Intentional copy.
-  for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
-    handles.emplace_back(pool.add(solve_sorted_list<Comparator>,
-                                  last_solution_hash, hash_prefix, n_elements,
-                                  std::cref(stop), std::ref(nonce), rand()));
-  }
-  return handles;
+// The key of this process's share of the challenge's nonces, which the
+// positions the workers reached are only good for.
+uint64_t share_key(const uint64_t challenge, const NonceSpace& nonce_space) {
+  return SolutionCache::key(std::to_string(challenge) + ' ' +
+                            std::to_string(nonce_space.process()) + '/' +
+                            std::to_string(nonce_space.processes()) + 'x' +
+                            std::to_string(nonce_space.workers()));
 }
 
-std::vector<JobHandle> start_shortest_path_jobs(const Document& message,
-                                                qp::threading::Threadpool& pool,
-                                                const std::atomic<bool>& stop,
-                                                GuardedValue<uint64_t>& nonce) {
-  const std::string& last_solution_hash =
-      message["last_solution_hash"].GetString();
-  const std::string& hash_prefix = message["hash_prefix"].GetString();
-  const int grid_size = message["parameters"]["grid_size"].GetInt();
-  const int n_blockers = message["parameters"]["nb_blockers"].GetInt();
-
-  std::vector<JobHandle> handles;
-  // Intentional copy.
-  for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
-    handles.emplace_back(pool.add(solve_shortest_path, last_solution_hash,
-                                  hash_prefix, grid_size, n_blockers,
-                                  std::cref(stop), std::ref(nonce), rand()));
-  }
-  return handles;
+using StartupClock = std::chrono::steady_clock;
+
+int64_t ms_since(const StartupClock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             StartupClock::now() - since)
+      .count();
 }
 
-std::vector<JobHandle> start_jobs(const Document& message,
-                                  qp::threading::Threadpool& pool,
-                                  const std::atomic<bool>& stop,
-                                  GuardedValue<uint64_t>& nonce) {
-  const std::string challenge_type = message["challenge_name"].GetString();
-  if (challenge_type == "sorted_list") {
-    return start_sorted_list_jobs<std::less<uint64_t>>(message, pool, stop,
-                                                       nonce);
-  } else if (challenge_type == "reverse_sorted_list") {
-    return start_sorted_list_jobs<std::greater<uint64_t>>(message, pool, stop,
-                                                          nonce);
-  } else if (challenge_type == "shortest_path") {
-    return start_shortest_path_jobs(message, pool, stop, nonce);
-  } else {
-    std::cerr << "Unsupported challenge type: " << challenge_type << std::endl;
-  }
-  return {};
+// A few attempts at each challenge with a specialized solver (see
+// solver_registry.h), so the buffers, tables and thread locals of the first
+// real challenge are allocated and faulted in while connecting.
+const char* const WARM_UP_CHALLENGES[][2] = {
+    {"sorted_list", "{\"nb_elements\":100}"},
+    {"reverse_sorted_list", "{\"nb_elements\":100}"},
+    {"shortest_path", "{\"grid_size\":25,\"nb_blockers\":80}"},
+};
+
+struct WarmUp {
+  explicit WarmUp(const unsigned workers) : workers_left(workers) {}
+  std::atomic<unsigned> workers_left;
+  // Milliseconds after startup the last worker was done, -1 until then.
+  std::atomic<int64_t> done_ms{-1};
+};
+
+// Solves the warm-up challenges, unless the first real one is published
+// first.  Every attempt matches the empty prefix and goes to a slot of the
+// worker's own, which stops each solver once it's full.  The solvers are
+// built for one worker, so none of them waits for the others.
+Challenge::Solve make_warm_up(const NonceSpace& nonce_space,
+                              const StartupClock::time_point started_at,
+                              std::shared_ptr<WarmUp> warm_up) {
+  return [=](const CancellationToken& superseded, const unsigned worker) {
+    const SeedHasher seed_hasher(std::string(64, '0'));
+    const PrefixMatcher matcher("");
+    for (const auto& challenge : WARM_UP_CHALLENGES) {
+      if (superseded) return;
+      Document parameters;
+      parameters.Parse(challenge[1]);
+      CancellationToken warm;
+      size_t attempts = 0;
+      SolutionSlot slot([&]() {
+        if (++attempts == SolutionSlot::MAX_CANDIDATES || superseded) {
+          warm.cancel();
+        }
+      });
+      const uint64_t epoch = slot.open();
+      NonceCursor nonces(nonce_space.sequence(worker), 0);
+      Solvers::with_solver(challenge[0], parameters, 1,
+                           [&](const auto& solver) {
+                             solver(seed_hasher, matcher, warm, slot, epoch,
+                                    nonces, worker);
+                           });
+    }
+    if (warm_up->workers_left.fetch_sub(1) == 1) {
+      warm_up->done_ms.store(ms_since(started_at));
+    }
+  };
 }
 
-void send_registration(uWS::WebSocket<uWS::CLIENT>& ws,
-                       const cscoins_wallet::CSCoinsWallet& wallet) {
-  StringBuffer buffer;
-  Writer<StringBuffer> writer(buffer);
-  writer.StartObject();
-  writer.Key("command");
-  writer.String("register_wallet");
-  writer.Key("args");
-  writer.StartObject();
-  writer.Key("name");
-  writer.String("DanglingPointers");
-  writer.Key("key");
-  writer.String(wallet.public_key().data());
-  writer.Key("signature");
-  writer.String(wallet.registration_signature().data());
-  writer.EndObject();
-  writer.EndObject();
-
-  ws.send(buffer.GetString());
+// Logs how long after startup, and after the challenge came in, the first
+// worker started on it.
+Challenge::Solve report_first_attempt(
+    Challenge::Solve solve, const StartupClock::time_point started_at,
+    const StartupClock::time_point received_at) {
+  auto reported = std::make_shared<std::atomic<bool>>(false);
+  return [=](const CancellationToken& superseded, const unsigned worker) {
+    if (!reported->exchange(true)) {
+      using std::chrono::duration_cast;
+      using std::chrono::microseconds;
+      std::cerr << "First attempt " << ms_since(started_at)
+                << " ms after startup, "
+                << duration_cast<microseconds>(StartupClock::now() -
+                                               received_at)
+                       .count()
+                << " us after the challenge came in" << std::endl;
+    }
+    solve(superseded, worker);
+  };
 }
 
-void send_submission(uWS::WebSocket<uWS::CLIENT>& ws, uint64_t nonce,
-                     const std::string& wallet_id) {
-  const auto nonce_string = std::to_string(nonce);
-  StringBuffer buffer;
-  Writer<StringBuffer> writer(buffer);
-  writer.StartObject();
-  writer.Key("command");
-  writer.String("submission");
-  writer.Key("args");
-  writer.StartObject();
-  writer.Key("wallet_id");
-  writer.String(wallet_id.data());
-  writer.Key("nonce");
-  writer.String(nonce_string.data());
-  writer.EndObject();
-  writer.EndObject();
-
-  ws.send(buffer.GetString());
+// Workers still winding down when the next challenge comes in aren't counted
+// in the nonces yet.  `handled` is how long its message took from arriving
+// to being published.
+void report_challenge(const Challenge& challenge,
+                      const std::chrono::nanoseconds handled,
+                      const NonceCoverage& coverage) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  const auto slowest = duration_cast<microseconds>(challenge.slowest_switch());
+  std::cerr << "Challenge " << challenge.version() << ": handled in "
+            << duration_cast<microseconds>(handled).count() << " us, "
+            << challenge.workers_switched() << " workers switched, slowest in "
+            << slowest.count() << " us; " << coverage.attempts()
+            << " nonces tried, " << coverage.duplicates() << " duplicates"
+            << std::endl;
+}
+
+// Pins the calling thread to the first physical core and returns one CPU on
+// each of the others for the workers, or nothing if there's only one core.
+std::vector<int> pin_network_thread() {
+  const auto cpus = cpu_topology::allowed_cpus();
+  const auto cores = cpu_topology::one_per_core(cpus);
+  if (cores.size() < 2 ||
+      !cpu_topology::pin_current_thread(
+          cpu_topology::siblings(cpus, cores.front()))) {
+    std::cerr << "Not pinning: can't spare a core for the network thread"
+              << std::endl;
+    return {};
+  }
+  std::vector<int> mining_cpus;
+  for (size_t i = 1; i < cores.size(); ++i) {
+    mining_cpus.push_back(cores[i].id);
+  }
+  return mining_cpus;
 }
 
-void wait_jobs(std::vector<JobHandle>& job_handles,
-               std::atomic<bool>& stopped) {
-  static std::mutex mu;
-  std::lock_guard<std::mutex> lock(mu);
+// Wakes the event loop up to dump the trace.  uv_async_send, under send(),
+// is safe to call from a signal handler; nothing else here would be.
+uS::Async* trace_requested = nullptr;
+volatile std::sig_atomic_t trace_signal = 0;
 
-  stopped = true;
-  for (auto& handle : job_handles) handle.wait();
-  stopped = false;
-  job_handles.clear();
+void request_trace_dump(const int signal) {
+  trace_signal = signal;
+  trace_requested->send();
 }
 
-int main() {
-  std::srand(time(nullptr));
+// Where the submission for the current challenge stands.
+enum class Submission { NONE, PENDING, ACCEPTED };
+
+// How long a submission may go unanswered before the next candidate goes
+// out, and how often that's checked.
+constexpr std::chrono::seconds RESUBMIT_AFTER(2);
+constexpr int RESUBMIT_CHECK_MS = 500;
+
+// How often how far the workers got goes to the solution cache.
+constexpr int CHECKPOINT_MS = 1000;
+
+void usage() {
+  std::cerr << "usage: DanglingPointerMiner [--kernel KERNEL=VARIANT]... "
+               "[--pin] [--huge-pages off|transparent|explicit] "
+               "[--stats-interval S] [--stats-port PORT] [--trace FILE] "
+               "[URL]"
+            << std::endl;
+  std::exit(1);
+}
+
+// Mines on the CS Games server, or on a DanglingPointerProxy given its URL.
+int main(int argc, char** argv) {
+  const auto started_at = StartupClock::now();
   std::ios_base::sync_with_stdio(false);
+  std::string server_url = "wss://cscoins.2017.csgames.org:8989/client";
+  autotune::Overrides kernels;
+  bool pin = false;
+  double stats_interval = 10;
+  int stats_port = 0;
+  std::string trace_file;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--kernel" && i + 1 < argc) {
+      if (!autotune::parse_override(argv[++i], kernels)) usage();
+    } else if (arg == "--pin") {
+      pin = true;
+    } else if (arg == "--huge-pages" && i + 1 < argc) {
+      if (!huge_pages::parse_mode(argv[++i], huge_pages::mode())) usage();
+    } else if (arg == "--stats-interval" && i + 1 < argc) {
+      stats_interval = std::stod(argv[++i]);
+    } else if (arg == "--stats-port" && i + 1 < argc) {
+      stats_port = std::stoi(argv[++i]);
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_file = argv[++i];
+    } else if (arg.compare(0, 2, "--") == 0 || i + 1 != argc) {
+      usage();
+    } else {
+      server_url = arg;
+    }
+  }
+  // Before any worker builds a seed hasher or a generator.
+  autotune::run(kernels);
+  const int64_t tuned_ms = ms_since(started_at);
+  // Before the workers start, so they show up by name.
+  if (!trace_file.empty()) {
+    trace::enable();
+    trace::name_thread("network");
+  }
 
-  std::atomic<bool> stop_jobs(false);
-  qp::threading::Threadpool thread_pool;
-  GuardedValue<uint64_t> nonce;
-  std::vector<JobHandle> job_handles;
+  // One worker per thread, for good.  They follow `challenges` from one
+  // challenge to the next on their own.  Several miners can share the wallet
+  // without repeating each other's nonces given MINER_PROCESS and
+  // MINER_PROCESSES, see nonce_space.h, or through a proxy, which hands out
+  // the shares itself.
+  //
+  // With --pin every worker gets a physical core of its own, and this
+  // thread, which runs the network loop, keeps the first core to itself.
+  const std::vector<int> mining_cpus =
+      pin ? pin_network_thread() : std::vector<int>();
+  NonceSpace nonce_space(0, 1,
+                         mining_cpus.empty()
+                             ? std::max(1u, std::thread::hardware_concurrency())
+                             : mining_cpus.size());
+  if (!NonceSpace::from_environment(nonce_space.workers(), nonce_space)) {
+    std::cerr << "MINER_PROCESS must be below MINER_PROCESSES" << std::endl;
+    usage();
+  }
+  std::unique_ptr<qp::threading::Threadpool> thread_pool(
+      mining_cpus.empty() ? new qp::threading::Threadpool()
+                          : new qp::threading::Threadpool(mining_cpus));
+  qp::threading::TaskGroup workers;
+  ChallengeFeed challenges;
+  for (unsigned i = 0; i < nonce_space.workers(); ++i) {
+    thread_pool->add(workers, [&challenges, i]() { challenges.work(i); });
+  }
+  // Warms the workers up while the wallet loads and the connection is set
+  // up; the first challenge supersedes it.
+  auto warm_up = std::make_shared<WarmUp>(nonce_space.workers());
+  challenges.publish(make_warm_up(nonce_space, started_at, warm_up));
+  std::shared_ptr<const Challenge> challenge;
+  std::chrono::nanoseconds challenge_handled{0};
+  // Kept when the server sends the same challenge again, so the workers pick
+  // up where they were.
+  std::shared_ptr<const ChallengeDescriptor> descriptor;
+  std::shared_ptr<NonceCoverage> coverage;
+  bool first_challenge = true;
+  // What earlier runs found and searched, see solution_cache.h, and the
+  // keys of the current challenge and share in it.
+  SolutionCache solution_cache("solutions.cache");
+  uint64_t cached_challenge = 0;
+  uint64_t cached_share = 0;
 
   uWS::Hub ws;
   uWS::WebSocket<uWS::CLIENT> csgames_socket;
+  // Set once a proxy hands us our share of the nonces; it takes submissions
+  // in its own format.
+  bool proxied = false;
 
+  const auto wallet_started_at = StartupClock::now();
   cscoins_wallet::CSCoinsWallet wallet("public.pem", "private.pem",
-                                       "public.der");
+                                       "public.der", "wallet.cache");
+  std::cerr << "Startup: kernels tuned in " << tuned_ms << " ms, wallet "
+            << (wallet.from_cache() ? "read from wallet.cache" : "checked")
+            << " in " << ms_since(wallet_started_at) << " ms" << std::endl;
+
+  // Neither parsing a message nor submitting a solution allocates; the
+  // submission is rendered once per wallet, or per challenge through a
+  // proxy, and only the nonce's digits are written in.
+  MessageParser parser;
+  SubmissionTemplate submission = submission_template(wallet.wallet_id());
+
+  // Solvers wake the event loop up through `solution_found`, and the
+  // submission goes out from the loop thread, so nothing spins waiting for
+  // one and it can't race a new challenge: a nonce for anything but the
+  // current challenge is never taken.
+  //
+  // One submission is out at a time.  The workers keep mining until the
+  // challenge is replaced, and the next solution they found goes out if the
+  // server rejects the last one or doesn't answer within RESUBMIT_AFTER.  A
+  // proxy answers every submission itself, eventually.
+  uS::Async* solution_found = new uS::Async(ws.getLoop());
+  SolutionSlot solutions([solution_found]() { solution_found->send(); });
+  Submission submitted = Submission::NONE;
+  uint64_t submitted_nonce = 0;
+  std::chrono::steady_clock::time_point submitted_at;
+  ServerReplies replies;
+  std::function<void()> submit_solution = [&]() {
+    if (submitted != Submission::NONE) return;
+    if (!solutions.take(submitted_nonce)) return;
+    solution_cache.add_solution(cached_challenge, submitted_nonce);
+    const trace::Span submitting("submit", "nonce", submitted_nonce);
+    send_submission(csgames_socket, submission, submitted_nonce);
+    replies.sent(ServerReplies::SUBMISSION, submitted_nonce);
+    submitted = Submission::PENDING;
+    submitted_at = std::chrono::steady_clock::now();
+  };
+  // An answer to anything but the pending submission is too late to matter.
+  const auto submission_answered = [&](const uint64_t nonce,
+                                       const bool accepted) {
+    if (submitted != Submission::PENDING || nonce != submitted_nonce) return;
+    if (accepted) {
+      submitted = Submission::ACCEPTED;
+      return;
+    }
+    std::cerr << "Nonce " << nonce << " rejected, trying another" << std::endl;
+    solution_cache.reject_solution(cached_challenge, nonce);
+    submitted = Submission::NONE;
+    submit_solution();
+  };
+  solution_found->setData(&submit_solution);
+  solution_found->start([](uS::Async* async) {
+    (*static_cast<std::function<void()>*>(async->getData()))();
+  });
+  std::function<void()> check_submission = [&]() {
+    if (proxied || submitted != Submission::PENDING ||
+        std::chrono::steady_clock::now() - submitted_at < RESUBMIT_AFTER) {
+      return;
+    }
+    std::cerr << "No answer to nonce " << submitted_nonce << ", trying another"
+              << std::endl;
+    submitted = Submission::NONE;
+    submit_solution();
+  };
+  uS::Timer* submission_timer = new uS::Timer(ws.getLoop());
+  submission_timer->setData(&check_submission);
+  submission_timer->start(
+      [](uS::Timer* timer) {
+        (*static_cast<std::function<void()>*>(timer->getData()))();
+      },
+      RESUBMIT_CHECK_MS, RESUBMIT_CHECK_MS);
+
+  // Workers don't stop to checkpoint; their cursors keep `coverage` up to
+  // date as they go.
+  std::function<void()> checkpoint = [&]() {
+    if (!coverage) return;
+    for (unsigned i = 0; i < nonce_space.workers(); ++i) {
+      solution_cache.add_searched(cached_share, i, coverage->searched(i));
+    }
+  };
+  uS::Timer* checkpoint_timer = new uS::Timer(ws.getLoop());
+  checkpoint_timer->setData(&checkpoint);
+  checkpoint_timer->start(
+      [](uS::Timer* timer) {
+        (*static_cast<std::function<void()>*>(timer->getData()))();
+      },
+      CHECKPOINT_MS, CHECKPOINT_MS);
 
   ws.onConnection([&](uWS::WebSocket<uWS::CLIENT> s, uWS::HttpRequest _) {
+    replies.reset();
     send_registration(s, wallet);
+    replies.sent(ServerReplies::REGISTRATION);
     s.send("{\"command\":\"get_current_challenge\",\"args\":{}}");
+    replies.sent(ServerReplies::CHALLENGE);
     csgames_socket = s;
+    const int64_t warmed_ms = warm_up->done_ms.load();
+    std::cerr << "Connected " << ms_since(started_at) << " ms after startup, ";
+    if (warmed_ms < 0) {
+      std::cerr << "workers still warming up" << std::endl;
+    } else {
+      std::cerr << "workers warmed up after " << warmed_ms << " ms"
+                << std::endl;
+    }
   });
 
   ws.onMessage([&](uWS::WebSocket<uWS::CLIENT> s, const char* message,
                    size_t length, uWS::OpCode) {
-    std::string actual_message(message, message + length);
-    const auto json_message = parse_json(actual_message);
+    const auto received_at = std::chrono::steady_clock::now();
+    trace::Span handling("message");
+    const auto& json_message = parser.parse(message, length);
+
+    if (command_of(json_message) == "nonce_space") {
+      const auto& args = json_message["args"];
+      nonce_space = NonceSpace(args["process"].GetUint(),
+                               args["processes"].GetUint(),
+                               nonce_space.workers());
+      proxied = true;
+      // The proxy only answers submissions, with a submission_result each.
+      replies.reset();
+      // Positions in the old share mean nothing in the new one.
+      coverage = nullptr;
+      descriptor = nullptr;
+      return;
+    }
+
+    ServerReplies::Sent answering;
+    const bool answer = !proxied && replies.answered(json_message, answering);
+    uint64_t result_challenge;
+    uint64_t result_nonce;
+    bool accepted;
+    if (is_submission_result(json_message, result_challenge, result_nonce,
+                             accepted)) {
+      if (descriptor && result_challenge == descriptor->id) {
+        submission_answered(result_nonce, accepted);
+      }
+      return;
+    }
+    if (answer && answering.command == ServerReplies::SUBMISSION) {
+      submission_answered(answering.nonce, !is_error(json_message));
+      return;
+    }
+    if (is_error(json_message)) {
+      std::cerr << "Server: " << std::string(message, length) << std::endl;
+      return;
+    }
 
     if (!is_challenge_message(json_message)) return;
 
-    wait_jobs(job_handles, stop_jobs);
+    if (challenge && coverage) {
+      report_challenge(*challenge, challenge_handled, *coverage);
+    }
 
-    job_handles = start_jobs(json_message, thread_pool, stop_jobs, nonce);
-  });
+    const uint64_t id = json_message["challenge_id"].GetUint64();
+    handling.set_arg("challenge", id);
+    if (!coverage || !descriptor || id != descriptor->id) {
+      coverage = std::make_shared<NonceCoverage>(nonce_space.workers());
+      descriptor = std::make_shared<const ChallengeDescriptor>(json_message);
+      if (proxied) submission = proxy_submission_template(id);
 
-  std::thread poll([&]() {
-    while (true) {
-      nonce.hold();
-      if (nonce.set()) {
-        send_submission(csgames_socket, nonce.get(), wallet.wallet_id());
-        wait_jobs(job_handles, stop_jobs);
+      // Picks up where an earlier run left the challenge.
+      cached_challenge = challenge_key(*descriptor, json_message["parameters"]);
+      cached_share = share_key(cached_challenge, nonce_space);
+      uint64_t skipped = 0;
+      for (unsigned i = 0; i < nonce_space.workers(); ++i) {
+        const uint64_t searched = solution_cache.searched(cached_share, i);
+        coverage->restore(i, searched);
+        skipped += searched;
+      }
+      const size_t known = solution_cache.solutions(cached_challenge).size();
+      if (skipped != 0 || known != 0) {
+        std::cerr << "Challenge " << id << " seen before: " << known
+                  << " solutions known, skipping " << skipped
+                  << " nonces already tried" << std::endl;
       }
-      nonce.unset();
-      nonce.drop();
-      std::this_thread::yield();
+    }
+    submitted = Submission::NONE;
+    const uint64_t epoch = solutions.open();
+    // Known solutions go out first, ahead of anything the workers find.
+    for (const uint64_t nonce : solution_cache.solutions(cached_challenge)) {
+      solutions.offer(epoch, nonce);
+    }
+    auto solve = make_solver(*descriptor, json_message["parameters"],
+                             solutions, epoch, nonce_space, coverage);
+    if (solve && first_challenge) {
+      solve = report_first_attempt(std::move(solve), started_at, received_at);
+      first_challenge = false;
+    }
+    if (solve) {
+      challenge = challenges.publish(std::move(solve));
+      challenge_handled = std::chrono::steady_clock::now() - received_at;
+    } else {
+      challenges.retire();
+      challenge = nullptr;
     }
   });
 
-  ws.connect("wss://cscoins.2017.csgames.org:8989/client", nullptr);
+  // What the workers are up to, logged every --stats-interval seconds and
+  // served as JSON on 127.0.0.1:--stats-port, both since the last log line.
+  const stats::Snapshot stats_start = stats::snapshot();
+  stats::Snapshot stats_previous = stats_start;
+  std::function<void()> log_stats = [&]() {
+    const stats::Snapshot now = stats::snapshot();
+    std::cerr << stats::log_line(stats_previous, now) << std::endl;
+    stats_previous = now;
+  };
+  if (stats::ENABLED && stats_interval > 0) {
+    const int interval_ms = stats_interval * 1000;
+    uS::Timer* stats_timer = new uS::Timer(ws.getLoop());
+    stats_timer->setData(&log_stats);
+    stats_timer->start(
+        [](uS::Timer* timer) {
+          (*static_cast<std::function<void()>*>(timer->getData()))();
+        },
+        interval_ms, interval_ms);
+  }
+  if (stats_port != 0) {
+    ws.onHttpRequest([&](uWS::HttpResponse* response, uWS::HttpRequest _,
+                         char* data, size_t length, size_t remaining) {
+      const std::string json =
+          stats::to_json(stats_start, stats_previous, stats::snapshot());
+      response->end(json.data(), json.size());
+    });
+    if (!ws.listen("127.0.0.1", stats_port)) {
+      std::cerr << "Can't serve stats on port " << stats_port << std::endl;
+    }
+  }
+
+  // --trace writes the trace out on SIGUSR1, and on SIGINT and SIGTERM
+  // before going down.
+  if (!trace_file.empty()) {
+    trace_requested = new uS::Async(ws.getLoop());
+    trace_requested->setData(&trace_file);
+    trace_requested->start([](uS::Async* async) {
+      const auto& path = *static_cast<std::string*>(async->getData());
+      if (trace::dump(path)) {
+        std::cerr << "Trace written to " << path << std::endl;
+      } else {
+        std::cerr << "Can't write the trace to " << path << std::endl;
+      }
+      const int signal = trace_signal;
+      if (signal != SIGUSR1) {
+        std::signal(signal, SIG_DFL);
+        std::raise(signal);
+      }
+    });
+    std::signal(SIGUSR1, request_trace_dump);
+    std::signal(SIGINT, request_trace_dump);
+    std::signal(SIGTERM, request_trace_dump);
+  }
+
+  ws.connect(server_url, nullptr);
   ws.run();
-  poll.join();
 }
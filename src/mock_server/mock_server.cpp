@@ -0,0 +1,338 @@
+// A stand-in for the CS Games server, to run miners (or a proxy) against end
+// to end on one machine and see how fast their solutions come back.
+//
+//   make mock_server
+//   ./MockServer [--port 8989] [--difficulty 4] [--interval S] [--rounds N]
+//                [--challenges sorted_list,reverse_sorted_list,shortest_path]
+//                [--elements 100] [--grid-size 25] [--blockers 80]
+//   ./DanglingPointerMiner ws://127.0.0.1:8989/
+//
+// Challenges go round the --challenges list with a random hash prefix of
+// --difficulty hex digits.  A challenge lasts until someone solves it, or at
+// most S seconds if --interval is given, and every client is sent the next
+// one right away.  Submissions are checked with check_solution.h, which
+// shares no code with the solvers.
+//
+// Every accepted or rejected submission is logged to stderr.  After N
+// challenges (never without --rounds) the server prints, per wallet, how many
+// submissions were accepted and rejected and the time from a challenge going
+// out to its solution coming back, as JSON, and exits.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Hub.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "check_solution.h"
+#include "cscoins_messages.h"
+
+using namespace rapidjson;
+using namespace cscoins_messages;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  int port = 8989;
+  unsigned difficulty = 4;
+  double interval = 0;  // 0 means until solved.
+  uint64_t rounds = 0;  // 0 means forever.
+  std::vector<std::string> challenges = {"sorted_list", "reverse_sorted_list",
+                                         "shortest_path"};
+  int n_elements = 100;
+  int grid_size = 25;
+  int n_blockers = 80;
+};
+
+std::vector<std::string> split(const std::string& list) {
+  std::vector<std::string> items;
+  size_t begin = 0;
+  while (begin < list.size()) {
+    const size_t end = std::min(list.find(',', begin), list.size());
+    items.push_back(list.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return items;
+}
+
+void usage() {
+  std::cerr << "usage: MockServer [--port PORT] [--difficulty D] "
+               "[--interval S] [--rounds N] [--challenges A,B] "
+               "[--elements N] [--grid-size N] [--blockers N]"
+            << std::endl;
+  std::exit(1);
+}
+
+Options parse_options(const int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 == argc) usage();
+    if (arg == "--port") {
+      options.port = std::stoi(argv[++i]);
+    } else if (arg == "--difficulty") {
+      options.difficulty = std::stoul(argv[++i]);
+    } else if (arg == "--interval") {
+      options.interval = std::stod(argv[++i]);
+    } else if (arg == "--rounds") {
+      options.rounds = std::stoull(argv[++i]);
+    } else if (arg == "--challenges") {
+      options.challenges = split(argv[++i]);
+    } else if (arg == "--elements") {
+      options.n_elements = std::stoi(argv[++i]);
+    } else if (arg == "--grid-size") {
+      options.grid_size = std::stoi(argv[++i]);
+    } else if (arg == "--blockers") {
+      options.n_blockers = std::stoi(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  for (const auto& name : options.challenges) {
+    if (name != "sorted_list" && name != "reverse_sorted_list" &&
+        name != "shortest_path") {
+      std::cerr << "Unknown challenge: " << name << std::endl;
+      usage();
+    }
+  }
+  if (options.challenges.empty() || options.difficulty > 64) usage();
+  return options;
+}
+
+struct Challenge {
+  uint64_t id = 0;
+  std::string name;
+  std::string last_solution_hash;
+  std::string hash_prefix;
+  // As sent to the clients.
+  std::string message;
+  Clock::time_point issued_at;
+};
+
+struct ClientStats {
+  uint64_t accepted = 0;
+  uint64_t rejected = 0;
+  std::vector<double> solve_ms;
+};
+
+std::string random_hex(std::mt19937_64& rng, const unsigned length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(length, '0');
+  for (auto& c : hex) c = digits[rng() % 16];
+  return hex;
+}
+
+std::string challenge_message(const Challenge& challenge,
+                              const Options& options) {
+  StringBuffer buffer;
+  Writer<StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("challenge_id");
+  writer.Uint64(challenge.id);
+  writer.Key("challenge_name");
+  writer.String(challenge.name.data());
+  writer.Key("last_solution_hash");
+  writer.String(challenge.last_solution_hash.data());
+  writer.Key("hash_prefix");
+  writer.String(challenge.hash_prefix.data());
+  writer.Key("parameters");
+  writer.StartObject();
+  if (challenge.name == "shortest_path") {
+    writer.Key("grid_size");
+    writer.Int(options.grid_size);
+    writer.Key("nb_blockers");
+    writer.Int(options.n_blockers);
+  } else {
+    writer.Key("nb_elements");
+    writer.Int(options.n_elements);
+  }
+  writer.EndObject();
+  writer.EndObject();
+  return buffer.GetString();
+}
+
+// The digest of the solution `nonce` leads to on `challenge`.
+std::string solution_digest(const Challenge& challenge,
+                            const Options& options, const uint64_t nonce) {
+  if (challenge.name == "shortest_path") {
+    return shortest_path_digest(challenge.last_solution_hash,
+                                options.grid_size, options.n_blockers, nonce);
+  }
+  const SortOrder order = challenge.name == "sorted_list"
+                              ? SortOrder::ASCENDING
+                              : SortOrder::DESCENDING;
+  return sorted_list_digest(order, challenge.last_solution_hash,
+                            options.n_elements, nonce);
+}
+
+double percentile(std::vector<double> values, const double p) {
+  std::sort(values.begin(), values.end());
+  const size_t rank = std::min(values.size() - 1,
+                               static_cast<size_t>(p * values.size()));
+  return values[rank];
+}
+
+void print_report(const std::map<std::string, ClientStats>& clients,
+                  const uint64_t rounds, const uint64_t unsolved) {
+  StringBuffer buffer;
+  Writer<StringBuffer> writer(buffer);
+  writer.StartObject();
+  writer.Key("challenges");
+  writer.Uint64(rounds);
+  writer.Key("unsolved");
+  writer.Uint64(unsolved);
+  writer.Key("clients");
+  writer.StartArray();
+  for (const auto& client : clients) {
+    const ClientStats& stats = client.second;
+    writer.StartObject();
+    writer.Key("wallet_id");
+    writer.String(client.first.data());
+    writer.Key("accepted");
+    writer.Uint64(stats.accepted);
+    writer.Key("rejected");
+    writer.Uint64(stats.rejected);
+    writer.Key("solve_ms");
+    if (stats.solve_ms.empty()) {
+      writer.Null();
+    } else {
+      writer.StartObject();
+      writer.Key("p50");
+      writer.Double(percentile(stats.solve_ms, 0.5));
+      writer.Key("p90");
+      writer.Double(percentile(stats.solve_ms, 0.9));
+      writer.Key("p99");
+      writer.Double(percentile(stats.solve_ms, 0.99));
+      writer.EndObject();
+    }
+    writer.EndObject();
+  }
+  writer.EndArray();
+  writer.EndObject();
+  std::cout << buffer.GetString() << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::ios_base::sync_with_stdio(false);
+  const Options options = parse_options(argc, argv);
+  std::mt19937_64 rng(std::random_device{}());
+
+  uWS::Hub ws;
+  // By the number kept in their user data.
+  std::map<uintptr_t, uWS::WebSocket<uWS::SERVER>> clients;
+  uintptr_t next_client = 1;
+
+  Challenge challenge;
+  challenge.last_solution_hash = random_hex(rng, 64);
+  bool solved = false;
+  uint64_t unsolved = 0;
+  std::map<std::string, ClientStats> stats;
+
+  // Replaces the current challenge, chaining from `solution_hash`.
+  std::function<void(const std::string&)> issue =
+      [&](const std::string& solution_hash) {
+        if (challenge.id != 0 && !solved) ++unsolved;
+        if (options.rounds != 0 && challenge.id == options.rounds) {
+          print_report(stats, challenge.id, unsolved);
+          std::exit(0);
+        }
+        ++challenge.id;
+        challenge.name =
+            options.challenges[(challenge.id - 1) % options.challenges.size()];
+        challenge.last_solution_hash = solution_hash;
+        challenge.hash_prefix = random_hex(rng, options.difficulty);
+        challenge.message = challenge_message(challenge, options);
+        challenge.issued_at = Clock::now();
+        solved = false;
+        for (auto& client : clients) {
+          client.second.send(challenge.message.data());
+        }
+      };
+
+  ws.onConnection([&](uWS::WebSocket<uWS::SERVER> s, uWS::HttpRequest _) {
+    s.setUserData(reinterpret_cast<void*>(next_client));
+    clients[next_client++] = s;
+  });
+
+  ws.onDisconnection([&](uWS::WebSocket<uWS::SERVER> s, int code,
+                         char* message, size_t length) {
+    clients.erase(reinterpret_cast<uintptr_t>(s.getUserData()));
+  });
+
+  ws.onMessage([&](uWS::WebSocket<uWS::SERVER> s, const char* message,
+                   size_t length, uWS::OpCode) {
+    const auto json_message = parse_json(std::string(message, length));
+    const std::string command = command_of(json_message);
+
+    if (command == "get_current_challenge") {
+      s.send(challenge.message.data());
+      return;
+    }
+    // Every command gets an answer, as from the server.
+    if (command == "register_wallet") {
+      s.send("{}");
+      return;
+    }
+    if (command != "submission") return;
+
+    std::string wallet_id;
+    uint64_t nonce;
+    if (!parse_submission(json_message, wallet_id, nonce)) {
+      std::cerr << "Dropped a malformed submission" << std::endl;
+      return;
+    }
+    const std::chrono::duration<double, std::milli> solve_ms =
+        Clock::now() - challenge.issued_at;
+    const std::string digest = solution_digest(challenge, options, nonce);
+    const bool accepted =
+        !digest.empty() && digest.compare(0, challenge.hash_prefix.size(),
+                                          challenge.hash_prefix) == 0;
+
+    ClientStats& client = stats[wallet_id];
+    std::cerr << "Challenge " << challenge.id << ": " << wallet_id
+              << (accepted ? " solved it" : " was rejected") << " after "
+              << solve_ms.count() << " ms" << std::endl;
+    send_submission_result(s, challenge.id, nonce, accepted);
+    if (!accepted) {
+      ++client.rejected;
+      return;
+    }
+    ++client.accepted;
+    client.solve_ms.push_back(solve_ms.count());
+    solved = true;
+    issue(digest);
+  });
+
+  // Challenges that outlive --interval are replaced from here.
+  std::function<void()> tick = [&]() {
+    const std::chrono::duration<double> age =
+        Clock::now() - challenge.issued_at;
+    if (options.interval > 0 && age.count() >= options.interval) {
+      issue(challenge.last_solution_hash);
+    }
+  };
+  uS::Timer* timer = new uS::Timer(ws.getLoop());
+  timer->setData(&tick);
+  timer->start(
+      [](uS::Timer* timer) {
+        (*static_cast<std::function<void()>*>(timer->getData()))();
+      },
+      10, 10);
+
+  if (!ws.listen(options.port)) {
+    std::cerr << "Can't listen on port " << options.port << std::endl;
+    return 1;
+  }
+  issue(challenge.last_solution_hash);
+  ws.run();
+}
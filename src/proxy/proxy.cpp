@@ -0,0 +1,263 @@
+// Holds the one connection a wallet has to the CS Games server and shares its
+// challenges out between miner processes, so one wallet can be mined from
+// several boxes without their connections racing each other.
+//
+//   make proxy
+//   ./DanglingPointerProxy [--port 8990] [--miners 16] [--upstream URL]
+//   ./DanglingPointerMiner ws://PROXY_HOST:8990/
+//
+// Every miner that connects is given its own share of the nonce space (see
+// nonce_space.h) and then gets every challenge the server sends.  The first
+// solution a miner finds for the current challenge goes to the server under
+// the proxy's wallet, and the miner gets the server's answer.  Solutions
+// coming in meanwhile are held back, up to MAX_HELD, and the next goes out if
+// the server rejects it; once one is accepted, every miner holding one is
+// told theirs was.  A share is given out again once its miner disconnects.
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Hub.h"
+
+#include "rapidjson/document.h"
+
+#include "cscoins_messages.h"
+#include "cscoins_wallet.h"
+
+using namespace rapidjson;
+using namespace cscoins_messages;
+
+// Solutions held back while one is out, at most.
+constexpr size_t MAX_HELD = 16;
+
+struct Options {
+  int port = 8990;
+  unsigned n_miners = 16;
+  std::string upstream_url = "wss://cscoins.2017.csgames.org:8989/client";
+};
+
+void usage() {
+  std::cerr << "usage: DanglingPointerProxy [--port PORT] [--miners N] "
+               "[--upstream URL]"
+            << std::endl;
+  std::exit(1);
+}
+
+Options parse_options(const int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--port" && i + 1 < argc) {
+      options.port = std::stoi(argv[++i]);
+    } else if (arg == "--miners" && i + 1 < argc) {
+      options.n_miners = std::stoul(argv[++i]);
+    } else if (arg == "--upstream" && i + 1 < argc) {
+      options.upstream_url = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if (options.n_miners == 0) usage();
+  return options;
+}
+
+// A miner's share is kept in its socket's user data, off by one so that
+// sockets turned away have none.
+void set_share(uWS::WebSocket<uWS::SERVER>& s, const unsigned share) {
+  s.setUserData(reinterpret_cast<void*>(uintptr_t(share) + 1));
+}
+
+bool get_share(uWS::WebSocket<uWS::SERVER>& s, unsigned& share) {
+  const uintptr_t data = reinterpret_cast<uintptr_t>(s.getUserData());
+  if (data == 0) return false;
+  share = data - 1;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::ios_base::sync_with_stdio(false);
+  const Options options = parse_options(argc, argv);
+
+  uWS::Hub ws;
+  uWS::WebSocket<uWS::CLIENT> csgames_socket;
+
+  cscoins_wallet::CSCoinsWallet wallet("public.pem", "private.pem",
+                                       "public.der", "wallet.cache");
+  MessageParser parser;
+  SubmissionTemplate submission = submission_template(wallet.wallet_id());
+
+  // Miner sockets by share.
+  std::vector<uWS::WebSocket<uWS::SERVER>> miners(options.n_miners);
+  std::vector<bool> connected(options.n_miners, false);
+
+  // The last challenge from the server, for miners connecting after it.
+  std::string challenge;
+  uint64_t challenge_id = 0;
+  uint64_t stale_submissions = 0;
+  uint64_t duplicate_submissions = 0;
+
+  // A miner's solution to the current challenge.
+  struct Candidate {
+    unsigned share;
+    uint64_t nonce;
+  };
+  // The one out to the server, if `pending`, and the ones held back.
+  bool pending = false;
+  bool accepted = false;
+  Candidate submitted{0, 0};
+  std::deque<Candidate> held;
+  ServerReplies replies;
+
+  const auto answer = [&](const Candidate& candidate, const bool accepted) {
+    if (connected[candidate.share]) {
+      send_submission_result(miners[candidate.share], challenge_id,
+                             candidate.nonce, accepted);
+    }
+  };
+  const auto submit = [&](const Candidate& candidate) {
+    submitted = candidate;
+    pending = true;
+    send_submission(csgames_socket, submission, candidate.nonce);
+    replies.sent(ServerReplies::SUBMISSION, candidate.nonce);
+  };
+  // The miners keep mining after a submission, so there's likely another
+  // held back if this one was rejected.
+  const auto submission_answered = [&](const uint64_t nonce,
+                                       const bool was_accepted) {
+    if (!pending || nonce != submitted.nonce) return;
+    pending = false;
+    answer(submitted, was_accepted);
+    if (was_accepted) {
+      accepted = true;
+      for (const Candidate& candidate : held) answer(candidate, true);
+      held.clear();
+    } else if (!held.empty()) {
+      submit(held.front());
+      held.pop_front();
+    }
+  };
+
+  ws.onConnection([&](uWS::WebSocket<uWS::CLIENT> s, uWS::HttpRequest _) {
+    replies.reset();
+    pending = false;
+    send_registration(s, wallet);
+    replies.sent(ServerReplies::REGISTRATION);
+    s.send("{\"command\":\"get_current_challenge\",\"args\":{}}");
+    replies.sent(ServerReplies::CHALLENGE);
+    csgames_socket = s;
+  });
+
+  ws.onMessage([&](uWS::WebSocket<uWS::CLIENT> s, const char* message,
+                   size_t length, uWS::OpCode) {
+    const auto& json_message = parser.parse(message, length);
+    ServerReplies::Sent answering;
+    const bool is_answer = replies.answered(json_message, answering);
+
+    if (!is_challenge_message(json_message)) {
+      uint64_t result_challenge;
+      uint64_t result_nonce;
+      bool was_accepted;
+      if (is_submission_result(json_message, result_challenge, result_nonce,
+                               was_accepted)) {
+        if (result_challenge == challenge_id) {
+          submission_answered(result_nonce, was_accepted);
+        }
+      } else if (is_answer &&
+                 answering.command == ServerReplies::SUBMISSION) {
+        submission_answered(answering.nonce, !is_error(json_message));
+      }
+      if (is_error(json_message)) {
+        std::cerr << "Server: " << std::string(message, length) << std::endl;
+      }
+      return;
+    }
+
+    const uint64_t id = json_message["challenge_id"].GetUint64();
+    if (id != challenge_id) {
+      std::cerr << "Challenge " << challenge_id << ": " << stale_submissions
+                << " stale and " << duplicate_submissions
+                << " duplicate submissions dropped" << std::endl;
+      challenge_id = id;
+      pending = false;
+      accepted = false;
+      held.clear();
+      stale_submissions = 0;
+      duplicate_submissions = 0;
+    }
+    challenge.assign(message, length);
+    for (unsigned i = 0; i < options.n_miners; ++i) {
+      if (connected[i]) miners[i].send(challenge.data());
+    }
+  });
+
+  ws.onConnection([&](uWS::WebSocket<uWS::SERVER> s, uWS::HttpRequest _) {
+    unsigned share = 0;
+    while (share < options.n_miners && connected[share]) ++share;
+    if (share == options.n_miners) {
+      std::cerr << "No share left for another miner" << std::endl;
+      s.close();
+      return;
+    }
+    set_share(s, share);
+    miners[share] = s;
+    connected[share] = true;
+    send_nonce_space(s, share, options.n_miners);
+    if (!challenge.empty()) s.send(challenge.data());
+  });
+
+  ws.onMessage([&](uWS::WebSocket<uWS::SERVER> s, const char* message,
+                   size_t length, uWS::OpCode) {
+    const auto& json_message = parser.parse(message, length);
+    const std::string command = command_of(json_message);
+
+    // Miners register and ask for the challenge like they would with the
+    // server; the proxy has done both already.
+    if (command == "get_current_challenge") {
+      if (!challenge.empty()) s.send(challenge.data());
+      return;
+    }
+    if (command != "proxy_submission") return;
+
+    uint64_t submitted_id;
+    uint64_t nonce;
+    if (!parse_proxy_submission(json_message, submitted_id, nonce)) {
+      std::cerr << "Dropped a malformed submission" << std::endl;
+      return;
+    }
+    if (submitted_id != challenge_id) {
+      ++stale_submissions;
+      return;
+    }
+    unsigned share;
+    if (!get_share(s, share)) return;
+    const Candidate candidate{share, nonce};
+    if (accepted) {
+      ++duplicate_submissions;
+      answer(candidate, true);
+    } else if (!pending) {
+      submit(candidate);
+    } else if (held.size() < MAX_HELD) {
+      held.push_back(candidate);
+    } else {
+      ++duplicate_submissions;
+      answer(candidate, false);
+    }
+  });
+
+  ws.onDisconnection([&](uWS::WebSocket<uWS::SERVER> s, int code,
+                         char* message, size_t length) {
+    unsigned share;
+    if (get_share(s, share)) connected[share] = false;
+  });
+
+  if (!ws.listen(options.port)) {
+    std::cerr << "Can't listen on port " << options.port << std::endl;
+    return 1;
+  }
+  ws.connect(options.upstream_url, nullptr);
+  ws.run();
+}
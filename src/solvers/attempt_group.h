@@ -0,0 +1,99 @@
+#ifndef __DANGMINER_ATTEMPT_GROUP__
+#define __DANGMINER_ATTEMPT_GROUP__
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "cancellation_token.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Splitting the workers into groups that run one attempt together, for
+// challenges too big for a core's caches: a worker's attempt then only
+// touches its share of the data, at the price of waiting for the others a
+// few times an attempt.  Group g is workers [first(g), first(g + 1)), so with
+// --pin its members sit on neighbouring cores.
+class GroupLayout {
+ public:
+  // `group_size` workers per group, as near as n_workers allows; the groups'
+  // sizes differ by at most one.
+  GroupLayout(const unsigned n_workers, const unsigned group_size)
+      : n_workers_(n_workers),
+        n_groups_(group_size == 0 || group_size >= n_workers
+                      ? 1
+                      : n_workers / group_size) {}
+
+  unsigned groups() const { return n_groups_; }
+
+  unsigned group_of(const unsigned worker) const {
+    return uint64_t(worker) * n_groups_ / n_workers_;
+  }
+  unsigned first(const unsigned group) const {
+    return (uint64_t(group) * n_workers_ + n_groups_ - 1) / n_groups_;
+  }
+  unsigned size(const unsigned group) const {
+    return first(group + 1) - first(group);
+  }
+  unsigned rank_of(const unsigned worker) const {
+    return worker - first(group_of(worker));
+  }
+
+ private:
+  unsigned n_workers_;
+  unsigned n_groups_;
+};
+
+// Where the members of a group wait for each other between the steps of an
+// attempt.  The waits are short, so they spin for a while before yielding.
+//
+// A worker may skip a challenge altogether when the next one comes in first,
+// so waiting also ends once the challenge is stopped, and the barrier is no
+// use after that.
+class GroupBarrier {
+ public:
+  explicit GroupBarrier(const unsigned size) : size_(size) {}
+  GroupBarrier(const GroupBarrier&) = delete;
+  GroupBarrier& operator=(const GroupBarrier&) = delete;
+
+  unsigned size() const { return size_; }
+
+  // Returns true once all `size` members have called it; what each did
+  // before is then visible to all of them.  Returns false if `stopped` is
+  // cancelled first.
+  bool wait(const CancellationToken& stopped) {
+    const uint64_t generation = generation_.load(std::memory_order_acquire);
+    if (arrived_.fetch_add(1, std::memory_order_acq_rel) + 1 == size_) {
+      // The others only arrive at the next barrier once they see the new
+      // generation.
+      arrived_.store(0, std::memory_order_relaxed);
+      generation_.store(generation + 1, std::memory_order_release);
+      return true;
+    }
+    for (unsigned spins = 0;
+         generation_.load(std::memory_order_acquire) == generation; ++spins) {
+      if (stopped) return false;
+      if (spins < SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    return true;
+  }
+
+ private:
+  static constexpr unsigned SPINS = 1 << 14;
+
+  const unsigned size_;
+  // Padded apart, so spinning on the generation doesn't slow down arriving.
+  std::atomic<unsigned> arrived_{0};
+  char padding_[64 - sizeof(std::atomic<unsigned>)];
+  std::atomic<uint64_t> generation_{0};
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef __DANGMINER_AUTOTUNE__
+#define __DANGMINER_AUTOTUNE__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "mersenne_twister.h"
+#include "multibuffer_sha256.h"
+#include "radix_sort.h"
+#include "sorted_list.h"
+#include "sorting_network.h"
+
+// Picks a version of every kernel (see cpu_dispatch.h) at startup by timing
+// each supported one on what a sorted list attempt asks of it, a few
+// milliseconds in all.  What's fastest depends on more than the instruction
+// sets: OpenSSL's SHA extensions beat AVX2 lanes on some CPUs and not on
+// others, and AVX-512 can cost more in clock speed than it gains.
+namespace autotune {
+
+// Variant names by kernel name, from --kernel KERNEL=VARIANT.  A kernel
+// named here isn't timed.
+using Overrides = std::map<std::string, std::string>;
+
+// Returns false if `arg` isn't KERNEL=VARIANT.
+inline bool parse_override(const std::string& arg, Overrides& overrides) {
+  const size_t equals = arg.find('=');
+  if (equals == std::string::npos || equals == 0 ||
+      equals + 1 == arg.size()) {
+    return false;
+  }
+  overrides[arg.substr(0, equals)] = arg.substr(equals + 1);
+  return true;
+}
+
+namespace detail {
+
+// Elements per list, as in the server's sorted list challenges so far.
+constexpr size_t ELEMENTS = 100;
+constexpr int ROUNDS = 3;
+constexpr int CALLS_PER_ROUND = 1000;
+
+// Keeps the timed work from being optimized away.
+inline void consume(const uint64_t value) {
+  static volatile uint64_t sink;
+  sink = sink + value;
+}
+
+// Nanoseconds per call of `run`, the best of ROUNDS.
+template <typename Run>
+double time_calls(Run& run) {
+  using Clock = std::chrono::steady_clock;
+  double best = 0;
+  for (int round = 0; round < ROUNDS; ++round) {
+    const auto start = Clock::now();
+    for (int call = 0; call < CALLS_PER_ROUND; ++call) run();
+    const std::chrono::duration<double, std::nano> elapsed =
+        Clock::now() - start;
+    const double per_call = elapsed.count() / CALLS_PER_ROUND;
+    if (round == 0 || per_call < best) best = per_call;
+  }
+  return best;
+}
+
+// Selects the variant of `kernel` the overrides name, or else the fastest
+// one.  `make_run` is called with each variant selected and returns what to
+// time, so whatever reads the kernel when it's built sees that variant.
+template <typename Impl, typename MakeRun>
+void tune(cpu_dispatch::Kernel<Impl>& kernel, const Overrides& overrides,
+          MakeRun make_run) {
+  const auto forced = overrides.find(kernel.name());
+  if (forced != overrides.end()) {
+    if (kernel.select(forced->second)) {
+      std::cerr << "Kernel " << kernel.name() << ": " << kernel.selected()
+                << " (forced)" << std::endl;
+    } else {
+      std::cerr << "Kernel " << kernel.name() << ": no supported variant "
+                << forced->second << ", keeping " << kernel.selected()
+                << std::endl;
+    }
+    return;
+  }
+
+  std::string best;
+  double best_ns = 0;
+  std::string timings;
+  for (const auto& variant : kernel.variants()) {
+    if (!variant.supported) continue;
+    kernel.select(variant.name);
+    auto run = make_run();
+    const double ns = time_calls(run);
+    if (best.empty() || ns < best_ns) {
+      best = variant.name;
+      best_ns = ns;
+    }
+    if (!timings.empty()) timings += ", ";
+    timings += variant.name;
+    timings += " " + std::to_string(static_cast<uint64_t>(ns)) + " ns";
+  }
+  kernel.select(best);
+  std::cerr << "Kernel " << kernel.name() << ": " << kernel.selected() << " ("
+            << timings << ")" << std::endl;
+}
+
+}  // namespace detail
+
+// Tunes every kernel.  Call once before any solver runs, since seed hashers
+// and generators keep the variants selected when they're built.
+inline void run(const Overrides& overrides = Overrides()) {
+  using detail::consume;
+
+  const std::vector<std::string> kernels = {
+      multibuffer_sha256::hash_batch_kernel().name(),
+      mersenne_twister::kernel().name(), sort_kernel().name(),
+      sorting_network::kernel().name()};
+  for (const auto& forced : overrides) {
+    if (std::find(kernels.begin(), kernels.end(), forced.first) ==
+        kernels.end()) {
+      std::cerr << "No kernel called " << forced.first << std::endl;
+    }
+  }
+
+  // One batch of seeds.
+  detail::tune(multibuffer_sha256::hash_batch_kernel(), overrides, [] {
+    const SeedHasher hasher(std::string(64, 'a'));
+    uint64_t nonce = 1000000000000;
+    return [hasher, nonce]() mutable {
+      uint64_t nonces[SEED_BATCH_SIZE];
+      uint64_t seeds[SEED_BATCH_SIZE];
+      for (auto& n : nonces) n = nonce++;
+      hasher.seeds(nonces, seeds);
+      consume(seeds[0]);
+    };
+  });
+
+  // Seeding the generator and drawing a list.
+  detail::tune(mersenne_twister::kernel(), overrides, [] {
+    MersenneTwister64 rng;
+    std::vector<uint64_t> list(detail::ELEMENTS);
+    uint64_t seed = 0;
+    return [rng, list, seed]() mutable {
+      rng.seed(seed++);
+      rng.generate(list.data(), list.size());
+      consume(list[0]);
+    };
+  });
+
+  // Sorting a list, from the same shuffled copy every time.
+  detail::tune(sort_kernel(), overrides, [] {
+    MersenneTwister64 rng;
+    std::vector<uint64_t> keys(detail::ELEMENTS);
+    rng.generate(keys.data(), keys.size());
+    std::vector<uint64_t> list(keys.size());
+    RadixSorter<SortOrder::ASCENDING> sorter;
+    const bool radix = sort_kernel().get() == SortAlgorithm::RADIX;
+    return [keys, list, sorter, radix]() mutable {
+      std::copy(keys.begin(), keys.end(), list.begin());
+      if (radix) {
+        sorter.sort(list.data(), list.size());
+      } else {
+        RadixSorter<SortOrder::ASCENDING>::comparison_sort(list.data(),
+                                                           list.size());
+      }
+      consume(list[0]);
+    };
+  });
+
+  // Sorting a batch of lists as wide as the widest kernel's, from the same
+  // shuffled copies every time.  "off" sorts them one by one with the sort
+  // kernel just picked.
+  detail::tune(sorting_network::kernel(), overrides, [] {
+    constexpr size_t N = detail::ELEMENTS;
+    constexpr size_t LISTS = sorting_network::MAX_WIDTH;
+    MersenneTwister64 rng;
+    std::vector<uint64_t> keys(N * LISTS);
+    rng.generate(keys.data(), keys.size());
+    for (auto& key : keys) {
+      key = sorting_network::encode<SortOrder::ASCENDING>(key);
+    }
+    std::vector<uint64_t> lists(keys.size());
+    const auto sort_batch =
+        sorting_network::sort_batch<N>(sorting_network::kernel().get());
+    const size_t step = sort_batch ? sorting_network::kernel().get() : 1;
+    RadixSorter<SortOrder::ASCENDING> sorter;
+    const bool radix = sort_kernel().get() == SortAlgorithm::RADIX;
+    return [keys, lists, sort_batch, step, sorter, radix]() mutable {
+      std::copy(keys.begin(), keys.end(), lists.begin());
+      for (size_t list = 0; list < LISTS; list += step) {
+        if (sort_batch != nullptr) {
+          sort_batch(lists.data() + list * N);
+        } else if (radix) {
+          sorter.sort(lists.data() + list * N, N);
+        } else {
+          RadixSorter<SortOrder::ASCENDING>::comparison_sort(
+              lists.data() + list * N, N);
+        }
+      }
+      consume(lists[0]);
+    };
+  });
+}
+
+}  // namespace autotune
+
+#endif
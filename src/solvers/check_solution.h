@@ -0,0 +1,104 @@
+#ifndef __DANGMINER_CHECK_SOLUTION__
+#define __DANGMINER_CHECK_SOLUTION__
+
+#include <openssl/sha.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "grid_state.h"
+#include "radix_sort.h"
+#include "shortest_path.h"
+
+// Works a nonce out the plain way, to check submissions with: std::to_string,
+// std::sort, the Dijkstra search and hex digests, none of the solvers' fast
+// paths.  Each function gives the hex digest of the solution the nonce
+// leads to; it solves the challenge if it starts with the hash prefix.
+
+namespace check_detail {
+
+inline std::string hex_sha256(const std::string& data) {
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(),
+         hash);
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (const unsigned char byte : hash) {
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xf];
+  }
+  return hex;
+}
+
+// The first 8 bytes of SHA-256(last_solution_hash + nonce), little endian.
+inline uint64_t seed_of(const uint64_t nonce,
+                        const std::string& last_solution_hash) {
+  const std::string message = last_solution_hash + std::to_string(nonce);
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(message.data()),
+         message.size(), hash);
+  uint64_t seed;
+  std::memcpy(&seed, hash, 8);
+  return seed;
+}
+
+}  // namespace check_detail
+
+inline std::string sorted_list_digest(const SortOrder order,
+                                      const std::string& last_solution_hash,
+                                      const int n_elements,
+                                      const uint64_t nonce) {
+  std::mt19937_64 rng(check_detail::seed_of(nonce, last_solution_hash));
+  std::vector<uint64_t> list(n_elements);
+  for (auto& i : list) i = rng();
+  std::sort(list.begin(), list.end());
+  if (order == SortOrder::DESCENDING) std::reverse(list.begin(), list.end());
+
+  std::string solution;
+  for (const auto i : list) solution += std::to_string(i);
+  return check_detail::hex_sha256(solution);
+}
+
+// Returns "" if the grid the nonce leads to has no path.
+inline std::string shortest_path_digest(const std::string& last_solution_hash,
+                                        const int grid_size,
+                                        const int n_blockers,
+                                        const uint64_t nonce) {
+  std::mt19937_64 rng(check_detail::seed_of(nonce, last_solution_hash));
+  const uint64_t size = grid_size;
+  DijkstraPathFinder finder(grid_size);
+  finder.reset();
+
+  State start{rng() % size, rng() % size, 0};
+  while (!finder.passable(start.row, start.col)) {
+    start.row = rng() % size;
+    start.col = rng() % size;
+  }
+  State end{rng() % size, rng() % size, 0};
+  while (end == start || !finder.passable(end.row, end.col)) {
+    end.row = rng() % size;
+    end.col = rng() % size;
+  }
+  for (int i = 0; i < n_blockers; ++i) {
+    const State blocker{rng() % size, rng() % size, 0};
+    if (blocker == start || blocker == end) continue;
+    finder.block(blocker.row, blocker.col);
+  }
+
+  std::vector<State> path;
+  const CancellationToken never;
+  if (!finder.find_path(start, end, never, path)) return "";
+
+  std::string solution;
+  for (const auto& state : path) {
+    solution += std::to_string(state.row);
+    solution += std::to_string(state.col);
+  }
+  return check_detail::hex_sha256(solution);
+}
+
+#endif
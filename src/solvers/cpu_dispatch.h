@@ -0,0 +1,89 @@
+#ifndef __DANGMINER_CPU_DISPATCH__
+#define __DANGMINER_CPU_DISPATCH__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Lets one binary carry several versions of a hot kernel, each built for an
+// instruction set the binary as a whole isn't, and pick one at run time.
+// The version used is the first one the CPU supports until autotune.h has
+// timed them all.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DANGMINER_X86_DISPATCH 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+// For the helpers of a kernel, so they're compiled for the instruction set
+// of the kernel calling them.
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+namespace cpu_dispatch {
+
+inline bool has_avx2() {
+#if defined(DANGMINER_X86_DISPATCH)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+inline bool has_avx512() {
+#if defined(DANGMINER_X86_DISPATCH)
+  return __builtin_cpu_supports("avx512f");
+#else
+  return false;
+#endif
+}
+
+// One version of a kernel.  `Impl` is whatever the kernel's callers need to
+// run it, usually a function pointer.
+template <typename Impl>
+struct Variant {
+  const char* name;
+  Impl impl;
+  bool supported;
+};
+
+// A kernel's versions, in order of preference, and the one in use.
+template <typename Impl>
+class Kernel {
+ public:
+  Kernel(const char* name, std::vector<Variant<Impl>> variants)
+      : name_(name), variants_(std::move(variants)) {
+    for (size_t i = 0; i < variants_.size(); ++i) {
+      if (variants_[i].supported) {
+        selected_ = i;
+        break;
+      }
+    }
+  }
+
+  const Impl& get() const { return variants_[selected_].impl; }
+
+  const char* name() const { return name_; }
+  const std::vector<Variant<Impl>>& variants() const { return variants_; }
+  const char* selected() const { return variants_[selected_].name; }
+
+  // Returns false if there's no supported version called `variant`.
+  bool select(const std::string& variant) {
+    for (size_t i = 0; i < variants_.size(); ++i) {
+      if (variants_[i].supported && variant == variants_[i].name) {
+        selected_ = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const char* name_;
+  std::vector<Variant<Impl>> variants_;
+  size_t selected_ = 0;
+};
+
+}  // namespace cpu_dispatch
+
+#endif
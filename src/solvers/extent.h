@@ -0,0 +1,62 @@
+#ifndef __DANGMINER_EXTENT__
+#define __DANGMINER_EXTENT__
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "huge_pages.h"
+
+// Template argument for a size only known at run time, like
+// std::dynamic_extent.  Anything else is a size fixed at compile time.
+constexpr size_t DYNAMIC_EXTENT = 0;
+
+// Extent * Factor, staying dynamic if Extent is.
+constexpr size_t scale_extent(const size_t extent, const size_t factor) {
+  return extent == DYNAMIC_EXTENT ? DYNAMIC_EXTENT : extent * factor;
+}
+
+// Extent elements held inline in the object owning them, which worker_local
+// allocates once per worker, and every loop over them has a constant trip
+// count.  The size passed to the constructor has to be Extent.
+template <typename T, size_t Extent>
+class ExtentArray {
+ public:
+  explicit ExtentArray(size_t) : items_() {}
+
+  static constexpr size_t size() { return Extent; }
+  T* data() { return items_.data(); }
+  const T* data() const { return items_.data(); }
+  T* begin() { return items_.data(); }
+  T* end() { return items_.data() + Extent; }
+  const T* begin() const { return items_.data(); }
+  const T* end() const { return items_.data() + Extent; }
+  T& operator[](const size_t i) { return items_[i]; }
+  const T& operator[](const size_t i) const { return items_[i]; }
+
+ private:
+  std::array<T, Extent> items_;
+};
+
+// A run time number of elements on the heap, or on huge pages if there are
+// enough of them.
+template <typename T>
+class ExtentArray<T, DYNAMIC_EXTENT> {
+ public:
+  explicit ExtentArray(const size_t size) : items_(size) {}
+
+  size_t size() const { return items_.size(); }
+  T* data() { return items_.data(); }
+  const T* data() const { return items_.data(); }
+  T* begin() { return items_.data(); }
+  T* end() { return items_.data() + items_.size(); }
+  const T* begin() const { return items_.data(); }
+  const T* end() const { return items_.data() + items_.size(); }
+  T& operator[](const size_t i) { return items_[i]; }
+  const T& operator[](const size_t i) const { return items_[i]; }
+
+ private:
+  std::vector<T, huge_pages::Allocator<T>> items_;
+};
+
+#endif
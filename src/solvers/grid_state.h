@@ -0,0 +1,53 @@
+#ifndef __DANGMINER_GRID_STATE__
+#define __DANGMINER_GRID_STATE__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+struct State {
+  uint64_t row;
+  uint64_t col;
+  uint64_t priority;
+
+  bool operator==(const State& rhs) const {
+    return row == rhs.row && col == rhs.col;
+  }
+
+  // Compare on priority FIRST, and then row and col.
+  bool operator<(const State& rhs) const {
+    if (priority != rhs.priority) return priority < rhs.priority;
+    if (row != rhs.row) return row < rhs.row;
+    return col < rhs.col;
+  }
+
+  // Compare on priority FIRST, and then row and col.
+  bool operator>(const State& rhs) const {
+    if (priority != rhs.priority) return priority > rhs.priority;
+    if (row != rhs.row) return row > rhs.row;
+    return col > rhs.col;
+  }
+};
+
+namespace std {
+
+template <>
+class hash<State> {
+ public:
+  // Thanks boost.
+  std::size_t operator()(const State& state) const {
+    std::size_t seed = 0;
+    std::hash<uint64_t> hash_value;
+
+    seed ^= hash_value(state.row) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= hash_value(state.col) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+  }
+};
+
+}  // namespace std
+
+const bool PASSABLE = true;
+const bool BLOCKED = false;
+
+#endif
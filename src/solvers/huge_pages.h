@@ -0,0 +1,151 @@
+#ifndef __DANGMINER_HUGE_PAGES__
+#define __DANGMINER_HUGE_PAGES__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Allocations big enough to fill whole 2MB pages, like the lists and radix
+// sort scratch of the long sorted list challenges, are mapped on their own
+// and backed by huge pages, which spares the TLB misses of walking them 4KB
+// at a time.  Everything smaller comes from the heap, cache line aligned.
+//
+// Like any memory, the pages are placed on the NUMA node of the thread that
+// touches them first, so a pinned worker's buffers end up local to it.
+namespace huge_pages {
+
+enum class Mode {
+  // Plain 4KB pages.
+  OFF,
+  // Asks for transparent huge pages with madvise(MADV_HUGEPAGE), which
+  // works unless they're disabled outright.
+  TRANSPARENT,
+  // Pages reserved in /proc/sys/vm/nr_hugepages, with a fallback to
+  // transparent ones once those run out.
+  EXPLICIT,
+};
+
+constexpr size_t PAGE_SIZE = size_t(2) << 20;
+
+// Set once at startup, before the solvers allocate anything.
+inline Mode& mode() {
+  static Mode mode = Mode::TRANSPARENT;
+  return mode;
+}
+
+// Returns false for anything but "off", "transparent" or "explicit".
+inline bool parse_mode(const std::string& name, Mode& parsed) {
+  if (name == "off") {
+    parsed = Mode::OFF;
+  } else if (name == "transparent") {
+    parsed = Mode::TRANSPARENT;
+  } else if (name == "explicit") {
+    parsed = Mode::EXPLICIT;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace detail {
+
+inline size_t mapped_size(const size_t bytes) {
+  return (bytes + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+#if defined(__linux__)
+
+// A mapping of `size` bytes aligned to PAGE_SIZE, so transparent huge pages
+// can back all of it.  Maps a page more than needed and trims the ends.
+inline void* map_aligned(const size_t size) {
+  void* p = mmap(nullptr, size + PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+  const uintptr_t aligned = (begin + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+  if (aligned != begin) munmap(p, aligned - begin);
+  munmap(reinterpret_cast<void*>(aligned + size),
+         begin + PAGE_SIZE - aligned);
+  return reinterpret_cast<void*>(aligned);
+}
+
+#endif
+
+}  // namespace detail
+
+// Allocations of at least this many bytes get mappings of their own.
+constexpr size_t MIN_MAPPED = PAGE_SIZE / 2;
+
+// At least 64 byte aligned.  Throws std::bad_alloc like operator new.
+inline void* allocate(const size_t bytes) {
+#if defined(__linux__)
+  if (bytes >= MIN_MAPPED) {
+    const size_t size = detail::mapped_size(bytes);
+    void* p = nullptr;
+    if (mode() == Mode::EXPLICIT) {
+      p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED) p = nullptr;
+    }
+    if (p == nullptr) {
+      p = detail::map_aligned(size);
+      if (p == nullptr) throw std::bad_alloc();
+      if (mode() != Mode::OFF) madvise(p, size, MADV_HUGEPAGE);
+    }
+    return p;
+  }
+#endif
+  void* p = nullptr;
+  if (posix_memalign(&p, 64, bytes == 0 ? 64 : bytes) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// `bytes` has to be what was passed to allocate().
+inline void deallocate(void* p, const size_t bytes) {
+  if (p == nullptr) return;
+#if defined(__linux__)
+  if (bytes >= MIN_MAPPED) {
+    munmap(p, detail::mapped_size(bytes));
+    return;
+  }
+#endif
+  std::free(p);
+}
+
+// For std::vector and friends.
+template <typename T>
+struct Allocator {
+  using value_type = T;
+
+  Allocator() = default;
+  template <typename U>
+  Allocator(const Allocator<U>&) {}
+
+  T* allocate(const size_t n) {
+    return static_cast<T*>(huge_pages::allocate(n * sizeof(T)));
+  }
+  void deallocate(T* p, const size_t n) {
+    huge_pages::deallocate(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const Allocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const Allocator<U>&) const {
+    return false;
+  }
+};
+
+}  // namespace huge_pages
+
+#endif
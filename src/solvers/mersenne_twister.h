@@ -0,0 +1,216 @@
+#ifndef __DANGMINER_MERSENNE_TWISTER__
+#define __DANGMINER_MERSENNE_TWISTER__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_dispatch.h"
+
+#if defined(DANGMINER_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace mersenne_twister {
+
+constexpr uint64_t MATRIX_A = 0xb5026f5aa96619e9;
+constexpr uint64_t UPPER_MASK = ~uint64_t(0) << 31;
+constexpr uint64_t LOWER_MASK = ~UPPER_MASK;
+
+inline uint64_t temper(uint64_t y) {
+  y ^= (y >> 29) & 0x5555555555555555;
+  y ^= (y << 17) & 0x71d67fffeda60000;
+  y ^= (y << 37) & 0xfff7eee000000000;
+  y ^= y >> 43;
+  return y;
+}
+
+inline uint64_t twist(const uint64_t x, const uint64_t next,
+                      const uint64_t far) {
+  const uint64_t y = (x & UPPER_MASK) | (next & LOWER_MASK);
+  return far ^ (y >> 1) ^ (-(next & 1) & MATRIX_A);
+}
+
+// Twists state[i, end) with the far word `offset` away and returns end.  The
+// words read are all at or past the ones written, or a whole M behind, so
+// several at a time gives the same result as one by one.
+using TwistRange = size_t (*)(uint64_t* state, size_t i, size_t end,
+                              ptrdiff_t offset);
+// out[i] = temper(words[i]) for i < n.
+using TemperRange = void (*)(const uint64_t* words, uint64_t* out, size_t n);
+
+struct Kernels {
+  TwistRange twist_range;
+  TemperRange temper_range;
+};
+
+inline size_t twist_range_scalar(uint64_t* state, size_t i, const size_t end,
+                                 const ptrdiff_t offset) {
+  for (; i < end; ++i) {
+    state[i] = twist(state[i], state[i + 1], state[i + offset]);
+  }
+  return i;
+}
+
+inline void temper_range_scalar(const uint64_t* words, uint64_t* out,
+                                const size_t n) {
+  for (size_t i = 0; i < n; ++i) out[i] = temper(words[i]);
+}
+
+#if defined(DANGMINER_X86_DISPATCH)
+
+TARGET_AVX2 inline __m256i load(const uint64_t* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 inline size_t twist_range_avx2(uint64_t* state, size_t i,
+                                           const size_t end,
+                                           const ptrdiff_t offset) {
+  const __m256i upper = _mm256_set1_epi64x(UPPER_MASK);
+  const __m256i lower = _mm256_set1_epi64x(LOWER_MASK);
+  const __m256i matrix = _mm256_set1_epi64x(MATRIX_A);
+  const __m256i one = _mm256_set1_epi64x(1);
+  for (; i + 4 <= end; i += 4) {
+    const __m256i x = load(state + i);
+    const __m256i next = load(state + i + 1);
+    const __m256i far = load(state + i + offset);
+    const __m256i y = _mm256_or_si256(_mm256_and_si256(x, upper),
+                                      _mm256_and_si256(next, lower));
+    const __m256i odd = _mm256_sub_epi64(_mm256_setzero_si256(),
+                                         _mm256_and_si256(next, one));
+    const __m256i twisted =
+        _mm256_xor_si256(_mm256_xor_si256(far, _mm256_srli_epi64(y, 1)),
+                         _mm256_and_si256(odd, matrix));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state + i), twisted);
+  }
+  return twist_range_scalar(state, i, end, offset);
+}
+
+TARGET_AVX2 inline void temper_range_avx2(const uint64_t* words,
+                                          uint64_t* out, const size_t n) {
+  const __m256i b = _mm256_set1_epi64x(0x5555555555555555);
+  const __m256i c = _mm256_set1_epi64x(0x71d67fffeda60000);
+  const __m256i d = _mm256_set1_epi64x(0xfff7eee000000000);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i y = load(words + i);
+    y = _mm256_xor_si256(y, _mm256_and_si256(_mm256_srli_epi64(y, 29), b));
+    y = _mm256_xor_si256(y, _mm256_and_si256(_mm256_slli_epi64(y, 17), c));
+    y = _mm256_xor_si256(y, _mm256_and_si256(_mm256_slli_epi64(y, 37), d));
+    y = _mm256_xor_si256(y, _mm256_srli_epi64(y, 43));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), y);
+  }
+  temper_range_scalar(words + i, out + i, n - i);
+}
+
+#endif
+
+inline cpu_dispatch::Kernel<Kernels>& kernel() {
+  static cpu_dispatch::Kernel<Kernels> kernel("mersenne_twister", {
+#if defined(DANGMINER_X86_DISPATCH)
+    {"avx2", {twist_range_avx2, temper_range_avx2}, cpu_dispatch::has_avx2()},
+#endif
+    {"scalar", {twist_range_scalar, temper_range_scalar}, true},
+  });
+  return kernel;
+}
+
+}  // namespace mersenne_twister
+
+// std::mt19937_64, output for output, made cheap to reseed.  Seeding only
+// stores the seed: the state words are filled in and twisted as outputs ask
+// for them, so an attempt drawing 100 numbers pays for about 256 of the 312
+// seeding steps and 100 of the 312 twists.  generate() draws a run of
+// outputs at once, with the twist and tempering done by the
+// mersenne_twister kernel selected when the generator was built.
+class MersenneTwister64 {
+ public:
+  using result_type = uint64_t;
+
+  static constexpr size_t N = 312;
+  static constexpr result_type DEFAULT_SEED = 5489u;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  explicit MersenneTwister64(const result_type value = DEFAULT_SEED)
+      : kernels_(mersenne_twister::kernel().get()) {
+    seed(value);
+  }
+
+  void seed(const result_type value) {
+    state_[0] = value;
+    seeded_ = 1;
+    twisted_ = 0;
+    next_ = 0;
+  }
+
+  result_type operator()() {
+    if (next_ == twisted_) refill(STEP);
+    return mersenne_twister::temper(state_[next_++]);
+  }
+
+  // The next `count` outputs, in order.
+  void generate(result_type* out, size_t count) {
+    while (count > 0) {
+      if (next_ == twisted_) refill(count);
+      const size_t n = std::min(count, twisted_ - next_);
+      kernels_.temper_range(state_ + next_, out, n);
+      next_ += n;
+      out += n;
+      count -= n;
+    }
+  }
+
+ private:
+  static constexpr size_t M = 156;
+  static constexpr result_type INIT_MULTIPLIER = 6364136223846793005;
+  // Words twisted at a time by operator().
+  static constexpr size_t STEP = 16;
+
+  // state_[0, twisted_) belongs to the current block, and the rest to the
+  // previous one, of which only [0, seeded_) exists yet right after seed().
+  result_type state_[N];
+  size_t seeded_;
+  size_t twisted_;
+  size_t next_;
+  mersenne_twister::Kernels kernels_;
+
+  // Twists up to `wanted` more words into the current block, starting a new
+  // block first if the current one is used up.
+  void refill(const size_t wanted) {
+    if (twisted_ == N) {
+      twisted_ = 0;
+      next_ = 0;
+    }
+    // Copies, so std::min and std::max don't need N and M defined.
+    const size_t n = N;
+    const size_t m = M;
+    const size_t end = std::min(n, next_ + wanted);
+
+    // Word i is twisted from words i and i + 1 of the previous block and
+    // word i + M of the previous block, or i - M of the current one past M.
+    seed_to(std::min(n, std::max(std::min(end, m) + m, end + 1)));
+
+    const auto twist_range = kernels_.twist_range;
+    size_t i = twisted_;
+    i = twist_range(state_, i, std::min(end, m), m);
+    i = twist_range(state_, std::max(i, m), std::min(end, n - 1),
+                    -ptrdiff_t(m));
+    if (end == N && i == N - 1) {
+      state_[N - 1] =
+          mersenne_twister::twist(state_[N - 1], state_[0], state_[M - 1]);
+    }
+    twisted_ = end;
+  }
+
+  void seed_to(const size_t end) {
+    for (size_t i = seeded_; i < end; ++i) {
+      const result_type previous = state_[i - 1];
+      state_[i] = INIT_MULTIPLIER * (previous ^ (previous >> 62)) + i;
+    }
+    seeded_ = std::max(seeded_, end);
+  }
+};
+
+#endif
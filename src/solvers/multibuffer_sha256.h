@@ -0,0 +1,304 @@
+#ifndef __DANGMINER_MULTIBUFFER_SHA256__
+#define __DANGMINER_MULTIBUFFER_SHA256__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_dispatch.h"
+
+// SHA-256 over several independent messages at once, one message per 32 bit
+// SIMD lane.  Only worth it when the messages are short and all pad out to
+// the same number of blocks, which is exactly the case for seed derivation.
+namespace multibuffer_sha256 {
+namespace detail {
+
+alignas(64) constexpr uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr uint32_t INITIAL_STATE[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                       0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                       0x1f83d9ab, 0x5be0cd19};
+
+inline uint32_t load_be32(const unsigned char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return __builtin_bswap32(v);
+}
+
+inline void store_be32(unsigned char* p, const uint32_t v) {
+  const uint32_t be = __builtin_bswap32(v);
+  std::memcpy(p, &be, 4);
+}
+
+// Width 32 bit lanes.  Only generic vector operations are used on them, so
+// the compiler emits them for the instruction set of whichever kernel below
+// they're inlined into: AVX-512, AVX2, or plain SSE2 or NEON at width 4.
+// They're only ever passed around inside the kernels, never by value across
+// a call, which is why the rotations are a macro.
+template <size_t Width>
+struct Lanes {
+  typedef uint32_t V __attribute__((vector_size(Width * 4)));
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// One compression of every lane.  `words` holds the 16 message words of the
+// block transposed, i.e. words[t * Width + lane].
+template <size_t Width>
+ALWAYS_INLINE void compress(typename Lanes<Width>::V state[8],
+                            const uint32_t* words) {
+  using V = typename Lanes<Width>::V;
+  V w[16];
+  for (int t = 0; t < 16; ++t) {
+    std::memcpy(&w[t], words + t * Width, sizeof(V));
+  }
+
+  V a = state[0], b = state[1], c = state[2], d = state[3];
+  V e = state[4], f = state[5], g = state[6], h = state[7];
+
+  // Fully unrolled so w[] and the working variables stay in registers.
+#pragma GCC unroll 64
+  for (int t = 0; t < 64; ++t) {
+    if (t >= 16) {
+      const V w15 = w[(t - 15) & 15];
+      const V w2 = w[(t - 2) & 15];
+      const V s0 = ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3);
+      const V s1 = ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10);
+      w[t & 15] += s0 + w[(t - 7) & 15] + s1;
+    }
+
+    const V s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+    const V t1 = h + s1 + ((e & f) ^ (~e & g)) + K[t] + w[t & 15];
+    const V s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+    const V t2 = s0 + ((a & b) | (c & (a | b)));
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+#undef ROTR
+
+inline size_t padded_blocks(const size_t length) {
+  return (length + 9 + 63) / 64;
+}
+
+inline uint32_t ror(const uint32_t x, const int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+// One compression of a single state, for the few blocks not worth batching.
+inline void compress_one(uint32_t state[8], const unsigned char block[64]) {
+  uint32_t w[64];
+  for (int t = 0; t < 16; ++t) w[t] = load_be32(block + t * 4);
+  for (int t = 16; t < 64; ++t) {
+    const uint32_t s0 =
+        ror(w[t - 15], 7) ^ ror(w[t - 15], 18) ^ (w[t - 15] >> 3);
+    const uint32_t s1 =
+        ror(w[t - 2], 17) ^ ror(w[t - 2], 19) ^ (w[t - 2] >> 10);
+    w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int t = 0; t < 64; ++t) {
+    const uint32_t s1 = ror(e, 6) ^ ror(e, 11) ^ ror(e, 25);
+    const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + K[t] + w[t];
+    const uint32_t s0 = ror(a, 2) ^ ror(a, 13) ^ ror(a, 22);
+    const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+}  // namespace detail
+
+// The state after compressing the whole blocks at the start of a message,
+// so messages sharing them only compress what comes after.
+struct Midstate {
+  uint32_t state[8];
+  // Bytes compressed, a multiple of 64.
+  uint64_t length;
+};
+
+// Compresses the first n_blocks blocks of `prefix`.
+inline Midstate midstate(const unsigned char* prefix, const size_t n_blocks) {
+  Midstate m;
+  std::memcpy(m.state, detail::INITIAL_STATE, sizeof(m.state));
+  for (size_t block = 0; block < n_blocks; ++block) {
+    detail::compress_one(m.state, prefix + block * 64);
+  }
+  m.length = uint64_t(n_blocks) * 64;
+  return m;
+}
+
+// Messages longer than this are never batched.
+constexpr size_t MAX_BLOCKS = 4;
+
+namespace detail {
+
+// Hashes Width messages at once into `digests`, each of them the prefix
+// `start` was computed from followed by messages[lane].  Every message must
+// pad out to the same number of blocks past the prefix (at most MAX_BLOCKS);
+// if they don't, false is returned.
+template <size_t Width>
+ALWAYS_INLINE bool hash_lanes(const Midstate& start,
+                              const unsigned char* const messages[Width],
+                              const size_t lengths[Width],
+                              unsigned char digests[Width][32]) {
+  using V = typename Lanes<Width>::V;
+  const size_t n_blocks = padded_blocks(lengths[0]);
+  if (n_blocks > MAX_BLOCKS) return false;
+  for (size_t lane = 1; lane < Width; ++lane) {
+    if (padded_blocks(lengths[lane]) != n_blocks) return false;
+  }
+
+  // Pad every message, then transpose the big-endian words so one vector
+  // load picks up the same word of every lane.
+  alignas(64) uint32_t words[MAX_BLOCKS * 16 * Width];
+  unsigned char padded[MAX_BLOCKS * 64];
+  for (size_t lane = 0; lane < Width; ++lane) {
+    const size_t length = lengths[lane];
+    std::memset(padded, 0, n_blocks * 64);
+    std::memcpy(padded, messages[lane], length);
+    padded[length] = 0x80;
+    const uint64_t bit_length = (start.length + length) * 8;
+    for (int i = 0; i < 8; ++i) {
+      padded[n_blocks * 64 - 1 - i] =
+          static_cast<unsigned char>(bit_length >> (8 * i));
+    }
+    for (size_t t = 0; t < n_blocks * 16; ++t) {
+      words[t * Width + lane] = load_be32(padded + t * 4);
+    }
+  }
+
+  V state[8];
+  for (int i = 0; i < 8; ++i) state[i] = V{} + start.state[i];
+  for (size_t block = 0; block < n_blocks; ++block) {
+    compress<Width>(state, words + block * 16 * Width);
+  }
+
+  alignas(64) uint32_t out[8 * Width];
+  std::memcpy(out, state, sizeof(state));
+  for (size_t lane = 0; lane < Width; ++lane) {
+    for (int i = 0; i < 8; ++i) {
+      store_be32(digests[lane] + i * 4, out[i * Width + lane]);
+    }
+  }
+  return true;
+}
+
+}  // namespace detail
+
+// Messages hashed per call of a HashBatch.
+constexpr size_t BATCH = 16;
+
+// Hashes BATCH messages continuing `start` into `digests`, or returns false
+// if they don't line up for it (see detail::hash_lanes) so the caller can
+// hash them one by one.
+using HashBatch = bool (*)(const Midstate& start,
+                           const unsigned char* const messages[BATCH],
+                           const size_t lengths[BATCH],
+                           unsigned char digests[BATCH][32]);
+
+namespace detail {
+
+template <size_t Width>
+ALWAYS_INLINE bool hash_batch(const Midstate& start,
+                              const unsigned char* const messages[BATCH],
+                              const size_t lengths[BATCH],
+                              unsigned char digests[BATCH][32]) {
+  for (size_t i = 0; i < BATCH; i += Width) {
+    if (!hash_lanes<Width>(start, messages + i, lengths + i, digests + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace detail
+
+#if defined(DANGMINER_X86_DISPATCH)
+
+TARGET_AVX512 inline bool hash_batch_avx512(
+    const Midstate& start, const unsigned char* const messages[BATCH],
+    const size_t lengths[BATCH], unsigned char digests[BATCH][32]) {
+  return detail::hash_batch<16>(start, messages, lengths, digests);
+}
+
+TARGET_AVX2 inline bool hash_batch_avx2(
+    const Midstate& start, const unsigned char* const messages[BATCH],
+    const size_t lengths[BATCH], unsigned char digests[BATCH][32]) {
+  return detail::hash_batch<8>(start, messages, lengths, digests);
+}
+
+#endif
+
+inline bool hash_batch_simd4(const Midstate& start,
+                             const unsigned char* const messages[BATCH],
+                             const size_t lengths[BATCH],
+                             unsigned char digests[BATCH][32]) {
+  return detail::hash_batch<4>(start, messages, lengths, digests);
+}
+
+// The seed hashing kernel.  "openssl" is a null HashBatch: the messages are
+// hashed one at a time by OpenSSL, which uses the SHA extensions on CPUs that
+// have them.
+inline cpu_dispatch::Kernel<HashBatch>& hash_batch_kernel() {
+  using cpu_dispatch::has_avx2;
+  using cpu_dispatch::has_avx512;
+  static cpu_dispatch::Kernel<HashBatch> kernel("seed_hash", {
+#if defined(DANGMINER_X86_DISPATCH)
+    {"avx512", hash_batch_avx512, has_avx512()},
+    {"avx2", hash_batch_avx2, has_avx2()},
+#endif
+    {"simd4", hash_batch_simd4, true},
+    {"openssl", nullptr, true},
+  });
+  return kernel;
+}
+
+}  // namespace multibuffer_sha256
+
+#endif
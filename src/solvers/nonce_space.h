@@ -0,0 +1,160 @@
+#ifndef __DANGMINER_NONCE_SPACE__
+#define __DANGMINER_NONCE_SPACE__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+// Splits the nonces between every worker of every miner process sharing a
+// wallet, so no two of them ever try the same nonce on a challenge.  Process p
+// gets the nonces equal to p modulo processes, whatever its number of
+// workers, and its worker w those equal to p + processes * w modulo
+// processes * workers, in increasing order; its position is how far along
+// that sequence it is.  Nonces still go through generate_seed like any other.
+
+struct NonceSequence {
+  uint64_t first;
+  uint64_t stride;
+
+  uint64_t operator[](const uint64_t position) const {
+    return first + position * stride;
+  }
+};
+
+class NonceSpace {
+ public:
+  NonceSpace(const unsigned process, const unsigned n_processes,
+             const unsigned n_workers)
+      : process_(process),
+        n_processes_(std::max(1u, n_processes)),
+        n_workers_(std::max(1u, n_workers)) {}
+
+  // This is process MINER_PROCESS (default 0) out of MINER_PROCESSES
+  // (default 1).  Returns false, leaving `space` alone, if MINER_PROCESS
+  // isn't below MINER_PROCESSES: it would mine another process's share.
+  static bool from_environment(const unsigned n_workers, NonceSpace& space) {
+    const char* process = std::getenv("MINER_PROCESS");
+    const char* n_processes = std::getenv("MINER_PROCESSES");
+    const unsigned long p = process ? std::strtoul(process, nullptr, 10) : 0;
+    const unsigned long n =
+        n_processes ? std::strtoul(n_processes, nullptr, 10) : 1;
+    if (p >= std::max(1ul, n)) return false;
+    space = NonceSpace(p, n, n_workers);
+    return true;
+  }
+
+  unsigned process() const { return process_; }
+  unsigned processes() const { return n_processes_; }
+  unsigned workers() const { return n_workers_; }
+
+  // Workers past the ones the space was made for share sequences, which
+  // NonceCoverage counts as duplicates.
+  NonceSequence sequence(const unsigned worker) const {
+    return NonceSequence{
+        process_ + uint64_t(n_processes_) * (worker % n_workers_),
+        uint64_t(n_processes_) * n_workers_};
+  }
+
+ private:
+  unsigned process_;
+  unsigned n_processes_;
+  unsigned n_workers_;
+};
+
+// Where a worker is in its sequence.  Given `progress`, it keeps it at the
+// position for other threads to read, for a relaxed store an attempt.
+class NonceCursor {
+ public:
+  NonceCursor(const NonceSequence& sequence, const uint64_t position,
+              std::atomic<uint64_t>* progress = nullptr)
+      : sequence_(sequence), position_(position), progress_(progress) {}
+
+  // The nonce `ahead` places after the current one.
+  uint64_t peek(const uint64_t ahead) const {
+    return sequence_[position_ + ahead];
+  }
+  void advance() {
+    ++position_;
+    if (progress_) progress_->store(position_, std::memory_order_relaxed);
+  }
+  uint64_t position() const { return position_; }
+
+ private:
+  const NonceSequence sequence_;
+  uint64_t position_;
+  std::atomic<uint64_t>* const progress_;
+};
+
+// How far this process's workers got through their sequences on one
+// challenge.  A worker resumes where the last one on its sequence stopped, so
+// a challenge sent twice isn't searched twice, and records how far it went
+// when it stops.
+class NonceCoverage {
+ public:
+  explicit NonceCoverage(const unsigned n_workers)
+      : n_workers_(std::max(1u, n_workers)),
+        reached_(new std::atomic<uint64_t>[n_workers_]),
+        progress_(new std::atomic<uint64_t>[n_workers_]) {
+    for (unsigned i = 0; i < n_workers_; ++i) {
+      reached_[i].store(0);
+      progress_[i].store(0);
+    }
+  }
+
+  uint64_t resume(const unsigned worker) const {
+    return reached_[worker % n_workers_].load(std::memory_order_relaxed);
+  }
+
+  // Positions before `position` were searched in an earlier run.
+  void restore(const unsigned worker, const uint64_t position) {
+    record(worker, position, position);
+  }
+
+  // For the worker's NonceCursor to keep up to date while it works.
+  std::atomic<uint64_t>* progress(const unsigned worker) {
+    return &progress_[worker % n_workers_];
+  }
+
+  // How far the worker got, whether it stopped since or not.
+  uint64_t searched(const unsigned worker) const {
+    return std::max(
+        resume(worker),
+        progress_[worker % n_workers_].load(std::memory_order_relaxed));
+  }
+
+  // The worker tried positions [start, end) of its sequence.
+  void record(const unsigned worker, const uint64_t start,
+              const uint64_t end) {
+    attempts_.fetch_add(end - start, std::memory_order_relaxed);
+    auto& reached = reached_[worker % n_workers_];
+    uint64_t previous = reached.load(std::memory_order_relaxed);
+    while (previous < end &&
+           !reached.compare_exchange_weak(previous, end,
+                                          std::memory_order_relaxed)) {
+    }
+    // Another worker on the same sequence got past `start` meanwhile.
+    if (previous > start) {
+      duplicates_.fetch_add(std::min(previous, end) - start,
+                            std::memory_order_relaxed);
+    }
+  }
+
+  // Nonces tried, and how many of them had already been.
+  uint64_t attempts() const {
+    return attempts_.load(std::memory_order_relaxed);
+  }
+  uint64_t duplicates() const {
+    return duplicates_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const unsigned n_workers_;
+  std::unique_ptr<std::atomic<uint64_t>[]> reached_;
+  std::unique_ptr<std::atomic<uint64_t>[]> progress_;
+  std::atomic<uint64_t> attempts_{0};
+  std::atomic<uint64_t> duplicates_{0};
+};
+
+#endif
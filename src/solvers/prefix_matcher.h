@@ -0,0 +1,136 @@
+#ifndef __DANGMINER_PREFIX_MATCHER__
+#define __DANGMINER_PREFIX_MATCHER__
+
+#include <openssl/sha.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Checks whether a raw SHA-256 digest starts with the hex digits of
+// hash_prefix.  The prefix is decoded once into a nibble mask and value over
+// the big-endian digest words, so checking a digest is one masked compare per
+// 16 hex digits instead of building a hex string.  Odd lengths just leave the
+// low nibble of the last byte out of the mask.
+
+namespace prefix_detail {
+
+inline int hex_digit_value(const char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  // Digests are spelled in lowercase hex.
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+inline uint64_t load_be64(const unsigned char* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return __builtin_bswap64(v);
+}
+
+// Decodes hex digits [16 * word, 16 * word + 16) of prefix.  Returns false if
+// any of them isn't a lowercase hex digit.
+inline bool decode_prefix_word(const std::string& prefix, const size_t word,
+                               uint64_t& mask, uint64_t& value) {
+  mask = 0;
+  value = 0;
+  for (size_t i = 0; i < 16 && word * 16 + i < prefix.size(); ++i) {
+    const int nibble = hex_digit_value(prefix[word * 16 + i]);
+    if (nibble < 0) return false;
+    const int shift = 60 - 4 * i;
+    mask |= uint64_t(0xF) << shift;
+    value |= uint64_t(nibble) << shift;
+  }
+  return true;
+}
+
+}  // namespace prefix_detail
+
+// Any prefix up to the full 64 hex digits of a digest.
+class PrefixMatcher {
+ public:
+  explicit PrefixMatcher(const std::string& hash_prefix)
+      : n_words_((hash_prefix.size() + 15) / 16) {
+    // Can't match more digits than a digest has, or anything that isn't hex.
+    possible_ = hash_prefix.size() <= 2 * SHA256_DIGEST_LENGTH;
+    for (size_t w = 0; possible_ && w < n_words_; ++w) {
+      possible_ = prefix_detail::decode_prefix_word(hash_prefix, w,
+                                                    mask_[w], value_[w]);
+    }
+  }
+
+  bool operator()(const unsigned char hash[SHA256_DIGEST_LENGTH]) const {
+    if (!possible_) return false;
+    for (size_t w = 0; w < n_words_; ++w) {
+      const uint64_t word = prefix_detail::load_be64(hash + 8 * w);
+      if ((word & mask_[w]) != value_[w]) return false;
+    }
+    return true;
+  }
+
+ private:
+  size_t n_words_;
+  bool possible_;
+  uint64_t mask_[4] = {};
+  uint64_t value_[4] = {};
+};
+
+// A prefix of exactly Nibbles hex digits, Nibbles < 16, checked with a
+// compile-time shift.  Only use it on valid hex prefixes; with_prefix_matcher
+// takes care of that.
+template <unsigned Nibbles>
+class FixedPrefixMatcher {
+  static_assert(Nibbles > 0 && Nibbles < 16, "Use PrefixMatcher instead.");
+
+ public:
+  explicit FixedPrefixMatcher(const std::string& hash_prefix) {
+    uint64_t mask;
+    prefix_detail::decode_prefix_word(hash_prefix, 0, mask, value_);
+    value_ >>= SHIFT;
+  }
+
+  bool operator()(const unsigned char hash[SHA256_DIGEST_LENGTH]) const {
+    return (prefix_detail::load_be64(hash) >> SHIFT) == value_;
+  }
+
+ private:
+  static constexpr unsigned SHIFT = 64 - 4 * Nibbles;
+  uint64_t value_;
+};
+
+// Calls f with the most specialized matcher for hash_prefix.  The lengths
+// with a FixedPrefixMatcher are the difficulties the server hands out;
+// everything else goes through the generic matcher.
+template <typename F>
+void with_prefix_matcher(const std::string& hash_prefix, F&& f) {
+  for (const char c : hash_prefix) {
+    if (prefix_detail::hex_digit_value(c) < 0) {
+      f(PrefixMatcher(hash_prefix));
+      return;
+    }
+  }
+
+  switch (hash_prefix.size()) {
+    case 3:
+      f(FixedPrefixMatcher<3>(hash_prefix));
+      break;
+    case 4:
+      f(FixedPrefixMatcher<4>(hash_prefix));
+      break;
+    case 5:
+      f(FixedPrefixMatcher<5>(hash_prefix));
+      break;
+    case 6:
+      f(FixedPrefixMatcher<6>(hash_prefix));
+      break;
+    case 7:
+      f(FixedPrefixMatcher<7>(hash_prefix));
+      break;
+    case 8:
+      f(FixedPrefixMatcher<8>(hash_prefix));
+      break;
+    default:
+      f(PrefixMatcher(hash_prefix));
+  }
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __DANGMINER_RADIX_SORT__
+#define __DANGMINER_RADIX_SORT__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "huge_pages.h"
+
+enum class SortOrder { ASCENDING, DESCENDING };
+
+// Which sort the sorted list solvers use.  The radix sort wins on the lists
+// the server has sent so far, but that's up to the CPU's caches.
+enum class SortAlgorithm { RADIX, STD };
+
+inline cpu_dispatch::Kernel<SortAlgorithm>& sort_kernel() {
+  static cpu_dispatch::Kernel<SortAlgorithm> kernel("sort", {
+    {"radix", SortAlgorithm::RADIX, true},
+    {"std", SortAlgorithm::STD, true},
+  });
+  return kernel;
+}
+
+// Below this many elements std::sort wins (see src/bench/sort_bench.cpp).
+constexpr size_t RADIX_SORT_MIN_ELEMENTS = 16;
+
+// Buckets at most this big are finished with an insertion sort, anything
+// bigger goes to std::sort.
+constexpr size_t RADIX_SORT_INSERTION_LIMIT = 32;
+
+// Keys in memory RadixSorter can swap with its scratch buffer.
+using SortKeys = std::vector<uint64_t, huge_pages::Allocator<uint64_t>>;
+
+// Integer sort for the uniformly random keys of the sorted list challenges.
+// One MSD pass scatters the keys by their top bits into roughly one bucket
+// per two keys, then every bucket is finished with a tiny comparison sort.
+// Descending order is handled by bucketing on the complemented key, so both
+// orders cost the same.
+//
+// The scratch buffers live as long as the sorter, so a worker that keeps one
+// around never allocates once it has seen its largest list.  Big ones are on
+// huge pages (see huge_pages.h).
+template <SortOrder Order>
+class RadixSorter {
+ public:
+  void sort(SortKeys& keys) {
+    if (keys.size() < RADIX_SORT_MIN_ELEMENTS) {
+      std::sort(keys.begin(), keys.end(), less);
+      return;
+    }
+    sort_into_scratch(keys.data(), keys.size());
+    keys.swap(scratch_);
+  }
+
+  // For keys that don't live in a vector, like a fixed size list held inline.
+  // Costs one extra copy back from the scratch buffer.  If the keys
+  // are known to share their top `common_bits` (complemented in descending
+  // order), the buckets split what's below instead.
+  void sort(uint64_t* keys, const size_t n, const int common_bits = 0) {
+    if (n < RADIX_SORT_MIN_ELEMENTS) {
+      comparison_sort(keys, n);
+      return;
+    }
+    sort_into_scratch(keys, n, common_bits);
+    std::copy(scratch_.begin(), scratch_.begin() + n, keys);
+  }
+
+  // std::sort in the same order.
+  static void comparison_sort(uint64_t* keys, const size_t n) {
+    std::sort(keys, keys + n, less);
+  }
+
+ private:
+  // 2^20 buckets keeps the histogram at 4MB.
+  static constexpr int MAX_BUCKET_BITS = 20;
+
+  SortKeys scratch_;
+  std::vector<uint32_t, huge_pages::Allocator<uint32_t>> counts_;
+
+  // Leaves the n keys sorted in scratch_[0, n).
+  void sort_into_scratch(const uint64_t* keys, const size_t n,
+                         const int common_bits = 0) {
+    int bits = 4;
+    while (bits < MAX_BUCKET_BITS && (size_t(2) << bits) <= n) ++bits;
+    const int shift = 64 - bits;
+    const size_t n_buckets = size_t(1) << bits;
+    const auto bucket = [common_bits, shift](const uint64_t k) {
+      return (key(k) << common_bits) >> shift;
+    };
+
+    // counts_[b + 1] is the size of bucket b, so after the prefix sum
+    // counts_[b] is where bucket b starts.
+    counts_.assign(n_buckets + 1, 0);
+    for (size_t i = 0; i < n; ++i) ++counts_[bucket(keys[i]) + 1];
+    for (size_t b = 1; b <= n_buckets; ++b) counts_[b] += counts_[b - 1];
+
+    // Scattering bumps counts_[b] up to where bucket b ends.
+    scratch_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      scratch_[counts_[bucket(keys[i])]++] = keys[i];
+    }
+
+    uint32_t begin = 0;
+    for (size_t b = 0; b < n_buckets; ++b) {
+      const uint32_t end = counts_[b];
+      const size_t size = end - begin;
+      if (size > RADIX_SORT_INSERTION_LIMIT) {
+        std::sort(scratch_.begin() + begin, scratch_.begin() + end, less);
+      } else if (size > 1) {
+        insertion_sort(scratch_.data() + begin, size);
+      }
+      begin = end;
+    }
+  }
+
+  static uint64_t key(const uint64_t k) {
+    return Order == SortOrder::ASCENDING ? k : ~k;
+  }
+
+  static bool less(const uint64_t a, const uint64_t b) {
+    return key(a) < key(b);
+  }
+
+  static void insertion_sort(uint64_t* first, const size_t size) {
+    for (size_t i = 1; i < size; ++i) {
+      const uint64_t value = first[i];
+      size_t j = i;
+      for (; j > 0 && less(value, first[j - 1]); --j) first[j] = first[j - 1];
+      first[j] = value;
+    }
+  }
+};
+
+#endif
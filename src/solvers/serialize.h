@@ -0,0 +1,170 @@
+#ifndef __DANGMINER_SERIALIZE__
+#define __DANGMINER_SERIALIZE__
+
+#include <openssl/sha.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "huge_pages.h"
+
+namespace serialize {
+
+// A uint64_t never needs more than this many decimal digits.
+constexpr size_t MAX_DECIMAL_DIGITS = 20;
+
+namespace detail {
+
+// POW10[0] is 0 rather than 1 so that decimal_length(0) comes out as 1.
+constexpr uint64_t POW10[MAX_DECIMAL_DIGITS] = {
+    0ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull};
+
+alignas(64) constexpr char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+struct Deallocate {
+  size_t bytes;
+  void operator()(char* p) const { huge_pages::deallocate(p, bytes); }
+};
+
+}  // namespace detail
+
+inline unsigned decimal_length(const uint64_t n) {
+  // floor(log10(2) * bit_length), which is either right or one short.
+  const unsigned t = ((64 - __builtin_clzll(n | 1)) * 1233) >> 12;
+  return t + (n >= detail::POW10[t]);
+}
+
+// Writes the decimal digits of n at out, without a terminator, and returns
+// the end of what was written.  Digits are produced two at a time from the
+// back so nothing needs reversing afterwards.
+inline char* write_decimal(uint64_t n, char* out) {
+  char* const end = out + decimal_length(n);
+  char* p = end;
+  while (n >= 100) {
+    const unsigned pair = (n % 100) * 2;
+    n /= 100;
+    p -= 2;
+    std::memcpy(p, detail::DIGIT_PAIRS + pair, 2);
+  }
+  if (n >= 10) {
+    std::memcpy(p - 2, detail::DIGIT_PAIRS + n * 2, 2);
+  } else {
+    p[-1] = static_cast<char>('0' + n);
+  }
+  return end;
+}
+
+// The decimal strings of 0..max_value laid out back to back, so a grid
+// coordinate can be copied into a SolutionBuffer without any arithmetic.
+class CoordinateStrings {
+ public:
+  explicit CoordinateStrings(const uint64_t max_value)
+      : offsets_(max_value + 2) {
+    chars_.resize((max_value + 1) * decimal_length(max_value));
+    char* p = chars_.data();
+    for (uint64_t i = 0; i <= max_value; ++i) {
+      offsets_[i] = p - chars_.data();
+      p = write_decimal(i, p);
+    }
+    offsets_[max_value + 1] = p - chars_.data();
+    max_length_ = decimal_length(max_value);
+  }
+
+  const char* data(const uint64_t i) const {
+    return chars_.data() + offsets_[i];
+  }
+  size_t length(const uint64_t i) const {
+    return offsets_[i + 1] - offsets_[i];
+  }
+  size_t max_length() const { return max_length_; }
+
+ private:
+  std::vector<char> chars_;
+  std::vector<uint32_t> offsets_;
+  size_t max_length_;
+};
+
+// Where a solution is serialized before it is hashed.  The storage is
+// cache line aligned (on huge pages once it's big) and only ever grows, so a
+// solver that keeps one around stops allocating after its first few
+// attempts, and the whole solution goes through SHA-256 in a single call
+// instead of one update per number.
+//
+// The append functions do NOT check the capacity; call reserve() with an
+// upper bound for the whole solution first.
+class SolutionBuffer {
+ public:
+  void clear() { size_ = 0; }
+
+  void reserve(const size_t capacity) {
+    if (capacity <= capacity_) return;
+
+    // Round up to a whole number of SHA-256 blocks.
+    const size_t rounded = (capacity + 63) & ~size_t(63);
+    std::unique_ptr<char, detail::Deallocate> grown(
+        static_cast<char*>(huge_pages::allocate(rounded)),
+        detail::Deallocate{rounded});
+    if (size_ != 0) std::memcpy(grown.get(), data_.get(), size_);
+    data_ = std::move(grown);
+    capacity_ = rounded;
+  }
+
+  void append_decimal(const uint64_t n) {
+    size_ = write_decimal(n, data_.get() + size_) - data_.get();
+  }
+
+  void append(const char* s, const size_t length) {
+    std::memcpy(data_.get() + size_, s, length);
+    size_ += length;
+  }
+
+  const char* data() const { return data_.get(); }
+  size_t size() const { return size_; }
+
+  void digest(unsigned char hash[SHA256_DIGEST_LENGTH]) const {
+    SHA256(reinterpret_cast<const unsigned char*>(data_.get()), size_, hash);
+  }
+
+ private:
+  std::unique_ptr<char, detail::Deallocate> data_{nullptr,
+                                                  detail::Deallocate{0}};
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+};
+
+}  // namespace serialize
+
+#endif
@@ -7,58 +7,21 @@
 #include <atomic>
 #include <cstring>
 #include <queue>
-#include <random>
 #include <string>
 #include <thread>
 #include <unordered_map>
 
-#include "guarded_value.h"
+#include "cancellation_token.h"
+#include "extent.h"
+#include "grid_state.h"
+#include "mersenne_twister.h"
+#include "nonce_space.h"
+#include "solution_slot.h"
 #include "sorted_list.h"  // For the utility functions.
-
-struct State {
-  uint64_t row;
-  uint64_t col;
-  uint64_t priority;
-
-  bool operator==(const State& rhs) const {
-    return row == rhs.row && col == rhs.col;
-  }
-
-  // Compare on priority FIRST, and then row and col.
-  bool operator<(const State& rhs) const {
-    if (priority != rhs.priority) return priority < rhs.priority;
-    if (row != rhs.row) return row < rhs.row;
-    return col < rhs.col;
-  }
-
-  // Compare on priority FIRST, and then row and col.
-  bool operator>(const State& rhs) const {
-    if (priority != rhs.priority) return priority > rhs.priority;
-    if (row != rhs.row) return row > rhs.row;
-    return col > rhs.col;
-  }
-};
-
-namespace std {
-
-template <>
-class hash<State> {
- public:
-  // Thanks boost.
-  std::size_t operator()(const State& state) const {
-    std::size_t seed = 0;
-    std::hash<uint64_t> hash_value;
-
-    seed ^= hash_value(state.row) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    seed ^= hash_value(state.col) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    return seed;
-  }
-};
-
-}  // namespace std
-
-const bool PASSABLE = true;
-const bool BLOCKED = false;
+#include "stats.h"
+#include "trace.h"
+#include "wavefront_path.h"
+#include "worker_local.h"
 
 void reset_grid(std::vector<std::vector<bool>>& grid) {
   // First row and last rows are blocked.
@@ -72,115 +35,59 @@ void reset_grid(std::vector<std::vector<bool>>& grid) {
   }
 }
 
-void solve_shortest_path(const std::string& last_solution_hash,
-                         const std::string& hash_prefix, const int grid_size,
-                         const int n_blockers, const std::atomic<bool>& stopped,
-                         GuardedValue<uint64_t>& nonce,
-                         const uint64_t initial_nonce) {
-  std::string buffer;
-  unsigned char hash[SHA256_DIGEST_LENGTH];
-  uint64_t last_nonce = initial_nonce;
-  const auto initial_seed =
-      generate_seed(last_nonce, last_solution_hash, buffer, hash);
-
-  std::mt19937_64 rng(initial_seed);
-  std::vector<std::vector<bool>> grid(grid_size, std::vector<bool>(grid_size));
-
-  std::unordered_map<State, uint64_t> cost_so_far;
-  std::unordered_map<State, State> came_from;
-  std::vector<State> path;
+// The original search: Dijkstra over hash maps.  Slow, but it defines which
+// path is the solution, so WavefrontPathFinder is checked against it.
+class DijkstraPathFinder {
+ public:
+  static constexpr size_t EXTENT = DYNAMIC_EXTENT;
 
-  const std::array<int, 4> delta_row{1, -1, 0, 0};
-  const std::array<int, 4> delta_col{0, 0, 1, -1};
+  explicit DijkstraPathFinder(const int grid_size)
+      : grid_size_(grid_size),
+        grid_(grid_size, std::vector<bool>(grid_size)) {}
 
-  uint64_t ugrid_size = grid_size;
+  void reset() { reset_grid(grid_); }
 
-  while (!stopped) {
-    last_nonce = rng();
-    const auto new_seed =
-        generate_seed(last_nonce, last_solution_hash, buffer, hash);
-    rng.seed(new_seed);
-
-    reset_grid(grid);
-    cost_so_far.clear();
-    came_from.clear();
-    path.clear();
+  bool passable(const uint64_t row, const uint64_t col) const {
+    return grid_[row][col] == PASSABLE;
+  }
 
-    uint64_t start_row = rng() % ugrid_size;
-    uint64_t start_col = rng() % ugrid_size;
-    while (grid[start_row][start_col] == BLOCKED) {
-      start_row = rng() % ugrid_size;
-      start_col = rng() % ugrid_size;
-    }
+  void block(const uint64_t row, const uint64_t col) {
+    grid_[row][col] = BLOCKED;
+  }
 
-    uint64_t end_row = rng() % ugrid_size;
-    uint64_t end_col = rng() % ugrid_size;
-    while ((start_row == end_row && start_col == end_col) ||
-           grid[end_row][end_col] == BLOCKED) {
-      end_row = rng() % ugrid_size;
-      end_col = rng() % ugrid_size;
-    }
+  // Fills `path` with the shortest path from start to end, both included.
+  // Returns false if end can't be reached or the search was stopped.
+  bool find_path(const State& start, const State& end,
+                 const CancellationToken& stopped, std::vector<State>& path) {
+    const std::array<int, 4> delta_row{1, -1, 0, 0};
+    const std::array<int, 4> delta_col{0, 0, 1, -1};
 
-    for (int i = 0; i < n_blockers; ++i) {
-      uint64_t block_row = rng() % ugrid_size;
-      uint64_t block_col = rng() % ugrid_size;
-      if ((block_row == start_row && block_col == start_col) ||
-          (block_row == end_row && block_col == end_col))
-        continue;
-      grid[block_row][block_col] = BLOCKED;
-    }
+    cost_so_far_.clear();
+    came_from_.clear();
+    path.clear();
 
     std::priority_queue<State, std::vector<State>,
                         std::greater<State>> /* the final */ frontier;
-    State start_state{start_row, start_col, 0};
+    State start_state{start.row, start.col, 0};
     frontier.emplace(start_state);
-    cost_so_far[start_state] = 0;
+    cost_so_far_[start_state] = 0;
 
     while (!frontier.empty() && !stopped) {
       const auto current = frontier.top();
       frontier.pop();
 
-      if (current.row == end_row && current.col == end_col) {
-        State item{end_row, end_col, 0};
-        while (came_from.find(item) != came_from.end()) {
+      if (current.row == end.row && current.col == end.col) {
+        State item{end.row, end.col, 0};
+        while (came_from_.find(item) != came_from_.end()) {
           path.push_back(item);
-          item = came_from[item];
+          item = came_from_[item];
         }
         path.push_back(item);
         std::reverse(path.begin(), path.end());
-
-        SHA256_CTX solution_ctx;
-        SHA256_Init(&solution_ctx);
-
-        for (const auto& state : path) {
-          custom_to_string(state.row, buffer);
-          SHA256_Update(&solution_ctx, buffer.data(), buffer.size());
-
-          custom_to_string(state.col, buffer);
-          SHA256_Update(&solution_ctx, buffer.data(), buffer.size());
-        }
-
-        SHA256_Final(hash, &solution_ctx);
-        buffer.clear();
-        for (unsigned i = 0; i < hash_prefix.length(); ++i) {
-          if ((i & 1ul) == 0ul) {
-            buffer.push_back(TO_HEX_CHAR(hash[i / 2] >> 4));
-          } else {
-            buffer.push_back(TO_HEX_CHAR(hash[i / 2] & 0x0F));
-          }
-        }
-
-        if (buffer == hash_prefix) {
-          nonce.hold();
-          nonce.set(last_nonce);
-          nonce.drop();
-          return;
-        } else {
-          break;
-        }
+        return true;
       }
 
-      const auto current_cost = cost_so_far[current];
+      const auto current_cost = cost_so_far_[current];
 
       for (size_t i = 0; i < delta_row.size(); ++i) {
         // NOTE: I don't think this will underflow since the 0'th row and col
@@ -189,14 +96,14 @@ void solve_shortest_path(const std::string& last_solution_hash,
         uint64_t next_row = current.row + delta_row[i];
         uint64_t next_col = current.col + delta_col[i];
 
-        if (next_row < ugrid_size && next_col < ugrid_size &&
-            (grid[next_row][next_col] == PASSABLE)) {
+        if (next_row < grid_size_ && next_col < grid_size_ &&
+            (grid_[next_row][next_col] == PASSABLE)) {
           const auto new_cost = current_cost + 1;
           State next_state{next_row, next_col, new_cost};
-          if (cost_so_far.find(next_state) == cost_so_far.end() ||
-              new_cost < cost_so_far[next_state]) {
-            cost_so_far[next_state] = new_cost;
-            came_from[next_state] = current;
+          if (cost_so_far_.find(next_state) == cost_so_far_.end() ||
+              new_cost < cost_so_far_[next_state]) {
+            cost_so_far_[next_state] = new_cost;
+            came_from_[next_state] = current;
 
             // RIP A*.  Using this makes our results inconsistent with theirs,
             // and thus it must be deleted.
@@ -213,6 +120,107 @@ void solve_shortest_path(const std::string& last_solution_hash,
         }
       }
     }
+    return false;
+  }
+
+ private:
+  const uint64_t grid_size_;
+  std::vector<std::vector<bool>> grid_;
+  std::unordered_map<State, uint64_t> cost_so_far_;
+  std::unordered_map<State, State> came_from_;
+};
+
+template <typename PathFinder, typename Matcher>
+void solve_shortest_path(const SeedHasher& seed_hasher,
+                         const Matcher& matches_prefix, const int grid_size,
+                         const int n_blockers, const CancellationToken& stopped,
+                         SolutionSlot& solutions, const uint64_t epoch,
+                         NonceCursor& nonces) {
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  SeedBatch seeds(seed_hasher, nonces);
+  uint64_t last_nonce;
+  uint64_t seed;
+
+  // Only seeds as much of its state as the attempt draws.
+  MersenneTwister64 rng;
+  // A finder with a fixed grid size makes it a constant here too, which turns
+  // the modulos below into multiplications.
+  const uint64_t ugrid_size =
+      PathFinder::EXTENT == DYNAMIC_EXTENT ? grid_size : PathFinder::EXTENT;
+  // Kept per worker thread, so a new challenge doesn't allocate unless its
+  // grid is a new size.
+  PathFinder& finder = worker_local<PathFinder>(grid_size);
+  const auto& coordinates =
+      worker_local<serialize::CoordinateStrings>(grid_size);
+  static thread_local std::vector<State> path;
+  static thread_local serialize::SolutionBuffer solution;
+
+  trace::AttemptTimer timer;
+  while (!stopped) {
+    seeds.next(last_nonce, seed);
+    timer.lap(stats::SEED);
+    rng.seed(seed);
+
+    finder.reset();
+
+    uint64_t start_row = rng() % ugrid_size;
+    uint64_t start_col = rng() % ugrid_size;
+    while (!finder.passable(start_row, start_col)) {
+      start_row = rng() % ugrid_size;
+      start_col = rng() % ugrid_size;
+    }
+
+    uint64_t end_row = rng() % ugrid_size;
+    uint64_t end_col = rng() % ugrid_size;
+    while ((start_row == end_row && start_col == end_col) ||
+           !finder.passable(end_row, end_col)) {
+      end_row = rng() % ugrid_size;
+      end_col = rng() % ugrid_size;
+    }
+
+    for (int i = 0; i < n_blockers; ++i) {
+      uint64_t block_row = rng() % ugrid_size;
+      uint64_t block_col = rng() % ugrid_size;
+      if ((block_row == start_row && block_col == start_col) ||
+          (block_row == end_row && block_col == end_col))
+        continue;
+      finder.block(block_row, block_col);
+    }
+    timer.lap(stats::GENERATE);
+
+    const bool found = finder.find_path(State{start_row, start_col, 0},
+                                        State{end_row, end_col, 0}, stopped,
+                                        path);
+    timer.lap(stats::SEARCH);
+    if (!found) {
+      // Stopped mid search: the nonce is left for whoever resumes.
+      if (stopped) break;
+      timer.no_path();
+      seeds.commit();
+      continue;
+    }
+
+    solution.clear();
+    solution.reserve(path.size() * 2 * coordinates.max_length());
+    for (const auto& state : path) {
+      solution.append(coordinates.data(state.row),
+                      coordinates.length(state.row));
+      solution.append(coordinates.data(state.col),
+                      coordinates.length(state.col));
+    }
+    timer.lap(stats::SERIALIZE);
+    solution.digest(hash);
+    timer.lap(stats::HASH);
+
+    const bool solved = matches_prefix(hash);
+    timer.lap(stats::CHECK);
+    timer.attempt();
+    // Keeps going until the challenge is replaced, for more candidates to
+    // fall back on if this one is rejected.
+    if (solved && solutions.offer(epoch, last_nonce)) {
+      trace::instant("solution", "nonce", last_nonce);
+    }
+    seeds.commit();
   }
 }
 
@@ -0,0 +1,223 @@
+#ifndef __DANGMINER_SOLVER_REGISTRY__
+#define __DANGMINER_SOLVER_REGISTRY__
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+#include "cancellation_token.h"
+#include "attempt_group.h"
+#include "extent.h"
+#include "nonce_space.h"
+#include "shortest_path.h"
+#include "solution_slot.h"
+#include "sorted_list.h"
+#include "wavefront_path.h"
+
+// Maps challenge names to solvers.  Each entry below knows its challenge's
+// name and parameters, and picks an instantiation specialized for them when
+// there is one.  Supporting a new challenge type is one more entry in
+// SolverRegistry at the bottom.
+
+// List lengths and grid sizes with their own instantiation, which holds the
+// buffers inline in the worker_local objects, on the heap, and makes the loop
+// bounds and modulos constants.  These are the parameters of the challenges
+// in src/bench/challenges.jsonl; add the ones the server hands out most.
+// Anything else gets the generic solver.
+using FIXED_LIST_LENGTHS = std::index_sequence<100>;
+using FIXED_GRID_SIZES = std::index_sequence<25>;
+
+// A solver is built for one challenge and `n_workers` workers, and each
+// of them calls it as
+//   solver(seed_hasher, matches_prefix, stopped, solutions, epoch, nonces,
+//          worker)
+// to work on the challenge until it's stopped, trying the nonces from the
+// cursor on and offering every solution it finds.  Copies share whatever
+// state the workers share.
+
+// Lists too big for a core's caches are sorted by groups of workers, one
+// attempt at a time (see SortedListGroup).
+template <SortOrder Order, size_t Elements>
+class SortedListSolver {
+ public:
+  SortedListSolver(const rapidjson::Value& parameters,
+                   const unsigned n_workers)
+      : n_elements_(parameters["nb_elements"].GetInt()) {
+    const unsigned group_size =
+        sorted_list_group_size(n_elements_, n_workers);
+    if (group_size > 1) {
+      groups_ = std::make_shared<Groups>(n_workers, group_size, n_elements_);
+    }
+  }
+
+  template <typename Matcher>
+  void operator()(const SeedHasher& seed_hasher,
+                  const Matcher& matches_prefix,
+                  const CancellationToken& stopped, SolutionSlot& solutions,
+                  const uint64_t epoch, NonceCursor& nonces,
+                  const unsigned worker) const {
+    if (groups_) {
+      solve_sorted_list_grouped<Order>(
+          seed_hasher, matches_prefix,
+          *groups_->groups[groups_->layout.group_of(worker)],
+          groups_->layout.rank_of(worker), stopped, solutions, epoch, nonces);
+      return;
+    }
+    solve_sorted_list<Order, Elements>(seed_hasher, matches_prefix,
+                                       n_elements_, stopped, solutions, epoch,
+                                       nonces);
+  }
+
+  // The parameter picking the instantiation.
+  static size_t extent(const rapidjson::Value& parameters) {
+    return parameters["nb_elements"].GetInt();
+  }
+
+ private:
+  struct Groups {
+    Groups(const unsigned n_workers, const unsigned group_size,
+           const size_t n_elements)
+        : layout(n_workers, group_size) {
+      for (unsigned g = 0; g < layout.groups(); ++g) {
+        groups.emplace_back(
+            new SortedListGroup(layout.size(g), n_elements));
+      }
+    }
+    GroupLayout layout;
+    std::vector<std::unique_ptr<SortedListGroup>> groups;
+  };
+
+  int n_elements_;
+  std::shared_ptr<Groups> groups_;
+};
+
+// Grids fit in a core's caches, so every worker has attempts of its own.
+template <size_t GridSize>
+class ShortestPathSolver {
+ public:
+  ShortestPathSolver(const rapidjson::Value& parameters, unsigned)
+      : grid_size_(parameters["grid_size"].GetInt()),
+        n_blockers_(parameters["nb_blockers"].GetInt()) {}
+
+  template <typename Matcher>
+  void operator()(const SeedHasher& seed_hasher,
+                  const Matcher& matches_prefix,
+                  const CancellationToken& stopped, SolutionSlot& solutions,
+                  const uint64_t epoch, NonceCursor& nonces,
+                  unsigned) const {
+    solve_shortest_path<BasicWavefrontPathFinder<GridSize>>(
+        seed_hasher, matches_prefix, grid_size_, n_blockers_, stopped,
+        solutions, epoch, nonces);
+  }
+
+  static size_t extent(const rapidjson::Value& parameters) {
+    return parameters["grid_size"].GetInt();
+  }
+
+ private:
+  int grid_size_;
+  int n_blockers_;
+};
+
+namespace registry_detail {
+
+template <template <size_t> class Solver, typename F>
+void with_extent(const size_t, const rapidjson::Value& parameters,
+                 const unsigned n_workers, F&& f, std::index_sequence<>) {
+  f(Solver<DYNAMIC_EXTENT>(parameters, n_workers));
+}
+
+// Calls f with Solver<Fixed> for the first Fixed equal to `extent`, or with
+// the generic Solver<DYNAMIC_EXTENT>.
+template <template <size_t> class Solver, typename F, size_t Fixed,
+          size_t... Rest>
+void with_extent(const size_t extent, const rapidjson::Value& parameters,
+                 const unsigned n_workers, F&& f,
+                 std::index_sequence<Fixed, Rest...>) {
+  if (extent == Fixed) {
+    f(Solver<Fixed>(parameters, n_workers));
+  } else {
+    with_extent<Solver>(extent, parameters, n_workers, std::forward<F>(f),
+                        std::index_sequence<Rest...>());
+  }
+}
+
+}  // namespace registry_detail
+
+template <SortOrder Order, typename FixedLengths = FIXED_LIST_LENGTHS>
+struct SortedListEntry {
+  template <size_t Elements>
+  using Solver = SortedListSolver<Order, Elements>;
+
+  static constexpr const char* NAME =
+      Order == SortOrder::ASCENDING ? "sorted_list" : "reverse_sorted_list";
+
+  template <typename F>
+  static void dispatch(const rapidjson::Value& parameters,
+                       const unsigned n_workers, F&& f) {
+    registry_detail::with_extent<Solver>(
+        Solver<DYNAMIC_EXTENT>::extent(parameters), parameters, n_workers,
+        std::forward<F>(f), FixedLengths());
+  }
+};
+
+template <typename FixedSizes = FIXED_GRID_SIZES>
+struct ShortestPathEntry {
+  static constexpr const char* NAME = "shortest_path";
+
+  template <typename F>
+  static void dispatch(const rapidjson::Value& parameters,
+                       const unsigned n_workers, F&& f) {
+    registry_detail::with_extent<ShortestPathSolver>(
+        ShortestPathSolver<DYNAMIC_EXTENT>::extent(parameters), parameters,
+        n_workers, std::forward<F>(f), FixedSizes());
+  }
+};
+
+template <typename... Entries>
+struct SolverRegistry {
+  // Calls f with the solver for the challenge, built for `n_workers`
+  // workers.  Returns false if there's no solver for challenge_name.
+  template <typename F>
+  static bool with_solver(const std::string& challenge_name,
+                          const rapidjson::Value& parameters,
+                          const unsigned n_workers, F&& f) {
+    return find<Entries...>(challenge_name, parameters, n_workers,
+                            std::forward<F>(f));
+  }
+
+ private:
+  template <typename F>
+  static bool find(const std::string&, const rapidjson::Value&, unsigned,
+                   F&&) {
+    return false;
+  }
+
+  template <typename Entry, typename... Rest, typename F>
+  static bool find(const std::string& challenge_name,
+                   const rapidjson::Value& parameters,
+                   const unsigned n_workers, F&& f) {
+    if (challenge_name == Entry::NAME) {
+      Entry::dispatch(parameters, n_workers, std::forward<F>(f));
+      return true;
+    }
+    return find<Rest...>(challenge_name, parameters, n_workers,
+                         std::forward<F>(f));
+  }
+};
+
+using Solvers = SolverRegistry<SortedListEntry<SortOrder::ASCENDING>,
+                               SortedListEntry<SortOrder::DESCENDING>,
+                               ShortestPathEntry<>>;
+
+// Only the generic solvers, to measure what the specializations are worth.
+using GenericSolvers = SolverRegistry<
+    SortedListEntry<SortOrder::ASCENDING, std::index_sequence<>>,
+    SortedListEntry<SortOrder::DESCENDING, std::index_sequence<>>,
+    ShortestPathEntry<std::index_sequence<>>>;
+
+#endif
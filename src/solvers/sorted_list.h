@@ -7,26 +7,28 @@
 #include <atomic>
 #include <cstring>
 #include <iostream>
-#include <random>
 #include <string>
 #include <thread>
+#include <vector>
 
-#include "guarded_value.h"
-
-#define TO_HEX_CHAR(c) ((c) < 10 ? '0' + (c) : 'a' + (c)-10)
+#include "attempt_group.h"
+#include "cancellation_token.h"
+#include "extent.h"
+#include "mersenne_twister.h"
+#include "multibuffer_sha256.h"
+#include "nonce_space.h"
+#include "prefix_matcher.h"
+#include "radix_sort.h"
+#include "serialize.h"
+#include "solution_slot.h"
+#include "sorting_network.h"
+#include "stats.h"
+#include "trace.h"
+#include "worker_local.h"
 
 void custom_to_string(uint64_t n, std::string& buffer) {
-  if (n == 0) {
-    buffer = "0";
-    return;
-  }
-
-  buffer.clear();
-  while (n != 0) {
-    buffer.push_back('0' + (n % 10));
-    n /= 10;
-  }
-  std::reverse(buffer.begin(), buffer.end());
+  char digits[serialize::MAX_DECIMAL_DIGITS];
+  buffer.assign(digits, serialize::write_decimal(n, digits));
 }
 
 uint64_t generate_seed(const uint64_t nonce,
@@ -47,62 +49,471 @@ uint64_t generate_seed(const uint64_t nonce,
   return new_seed;
 }
 
-template <typename Comparator>
-void solve_sorted_list(const std::string& last_solution_hash,
-                       const std::string& hash_prefix, const int n_elements,
-                       const std::atomic<bool>& stopped,
-                       GuardedValue<uint64_t>& nonce,
-                       const uint64_t initial_nonce) {
-  std::string buffer;
-  Comparator cmp;
+// Number of nonces whose seeds are derived together.
+constexpr size_t SEED_BATCH_SIZE = multibuffer_sha256::BATCH;
+
+// generate_seed for every nonce of one challenge.  The whole blocks at the
+// start of last_solution_hash, which is all of a 64 character one, are
+// compressed once here, so each seed only compresses the block holding the
+// nonce.  Built once per challenge and shared read only by its workers.
+class SeedHasher {
+ public:
+  explicit SeedHasher(const std::string& last_solution_hash)
+      : tail_(last_solution_hash, last_solution_hash.size() / 64 * 64),
+        hash_batch_(multibuffer_sha256::hash_batch_kernel().get()) {
+    const size_t n_blocks = last_solution_hash.size() / 64;
+    const auto* data =
+        reinterpret_cast<const unsigned char*>(last_solution_hash.data());
+    midstate_ = multibuffer_sha256::midstate(data, n_blocks);
+    SHA256_Init(&prefix_);
+    SHA256_Update(&prefix_, data, n_blocks * 64);
+  }
+
+  uint64_t seed(const uint64_t nonce) const {
+    unsigned char message[MAX_MESSAGE];
+    const size_t length = write_message(nonce, message);
+    SHA256_CTX ctx = prefix_;
+    SHA256_Update(&ctx, message, length);
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_Final(hash, &ctx);
+
+    uint64_t new_seed = 0;
+    std::memcpy(&new_seed, hash, 8);
+    return new_seed;
+  }
+
+  // seeds[i] = seed(nonces[i]), with the seed_hash kernel selected when
+  // this was built.
+  void seeds(const uint64_t nonces[SEED_BATCH_SIZE],
+             uint64_t seeds[SEED_BATCH_SIZE]) const {
+    if (hash_batch_ != nullptr) {
+      unsigned char messages[SEED_BATCH_SIZE][MAX_MESSAGE];
+      const unsigned char* data[SEED_BATCH_SIZE];
+      size_t lengths[SEED_BATCH_SIZE];
+      for (size_t i = 0; i < SEED_BATCH_SIZE; ++i) {
+        lengths[i] = write_message(nonces[i], messages[i]);
+        data[i] = messages[i];
+      }
+
+      unsigned char digests[SEED_BATCH_SIZE][32];
+      if (hash_batch_(midstate_, data, lengths, digests)) {
+        for (size_t i = 0; i < SEED_BATCH_SIZE; ++i) {
+          std::memcpy(&seeds[i], digests[i], 8);
+        }
+        return;
+      }
+    }
+
+    // OpenSSL selected, or the messages don't line up into the same number of
+    // blocks.
+    for (size_t i = 0; i < SEED_BATCH_SIZE; ++i) seeds[i] = seed(nonces[i]);
+  }
+
+ private:
+  static constexpr size_t MAX_MESSAGE = 63 + serialize::MAX_DECIMAL_DIGITS;
+
+  // What's left of last_solution_hash past the compressed blocks.
+  const std::string tail_;
+  multibuffer_sha256::Midstate midstate_;
+  SHA256_CTX prefix_;
+  multibuffer_sha256::HashBatch hash_batch_;
+
+  // The rest of the message after the compressed blocks.
+  size_t write_message(const uint64_t nonce, unsigned char* out) const {
+    char* p = reinterpret_cast<char*>(out);
+    std::memcpy(p, tail_.data(), tail_.size());
+    return serialize::write_decimal(nonce, p + tail_.size()) - p;
+  }
+};
+
+// Hands out (nonce, seed) pairs one at a time while deriving the seeds
+// SEED_BATCH_SIZE at a time.  Nonces come from the worker's share of the
+// nonce space, and the cursor only moves past the ones commit() says were
+// tried, in the order they were handed out, so an attempt cut short by a
+// stop isn't counted as searched.
+class SeedBatch {
+ public:
+  SeedBatch(const SeedHasher& seed_hasher, NonceCursor& nonces)
+      : seed_hasher_(seed_hasher), cursor_(nonces) {}
+
+  void next(uint64_t& nonce, uint64_t& seed) {
+    if (next_ == SEED_BATCH_SIZE) {
+      for (size_t i = 0; i < SEED_BATCH_SIZE; ++i) {
+        nonces_[i] = cursor_.peek(handed_out_ + i);
+      }
+      seed_hasher_.seeds(nonces_.data(), seeds_.data());
+      next_ = 0;
+    }
+    nonce = nonces_[next_];
+    seed = seeds_[next_];
+    ++next_;
+    ++handed_out_;
+  }
+
+  // The oldest nonce handed out and not committed yet was tried.
+  void commit() {
+    --handed_out_;
+    cursor_.advance();
+  }
+
+ private:
+  const SeedHasher& seed_hasher_;
+  NonceCursor& cursor_;
+  std::array<uint64_t, SEED_BATCH_SIZE> nonces_;
+  std::array<uint64_t, SEED_BATCH_SIZE> seeds_;
+  size_t next_ = SEED_BATCH_SIZE;
+  // Nonces handed out past the cursor.
+  size_t handed_out_ = 0;
+};
+
+// solve_sorted_list for a batch of `width` lists at a time, sorted together
+// by `sort_batch` (see sorting_network.h), each hashed as it always is.
+template <SortOrder Order, size_t Elements, typename Matcher>
+void solve_sorted_list_batched(const SeedHasher& seed_hasher,
+                               const Matcher& matches_prefix,
+                               const int n_elements, const size_t width,
+                               const sorting_network::SortBatch sort_batch,
+                               const CancellationToken& stopped,
+                               SolutionSlot& solutions, const uint64_t epoch,
+                               NonceCursor& nonces) {
   unsigned char hash[SHA256_DIGEST_LENGTH];
-  uint64_t last_nonce = initial_nonce;
-  const auto initial_seed =
-      generate_seed(last_nonce, last_solution_hash, buffer, hash);
+  SeedBatch seeds(seed_hasher, nonces);
+  uint64_t batch_nonces[sorting_network::MAX_WIDTH];
+  uint64_t seed;
 
-  std::mt19937_64 rng(initial_seed);
-  std::vector<std::uint64_t> list(n_elements);
+  MersenneTwister64 rng;
+  auto& list = worker_local<ExtentArray<uint64_t, Elements>>(n_elements);
+  // Key i of lane l at columns[i * width + l].
+  auto& columns = worker_local<ExtentArray<
+      uint64_t, scale_extent(Elements, sorting_network::MAX_WIDTH)>>(
+      n_elements * sorting_network::MAX_WIDTH);
+  static thread_local serialize::SolutionBuffer solution;
+  solution.reserve(list.size() * serialize::MAX_DECIMAL_DIGITS);
 
+  trace::AttemptTimer timer;
   while (!stopped) {
-    for (auto& i : list) {
-      i = rng();
+    for (size_t lane = 0; lane < width; ++lane) {
+      seeds.next(batch_nonces[lane], seed);
+      timer.lap(stats::SEED);
+      rng.seed(seed);
+      rng.generate(list.data(), list.size());
+      for (size_t i = 0; i < list.size(); ++i) {
+        columns[i * width + lane] = sorting_network::encode<Order>(list[i]);
+      }
+      timer.lap(stats::GENERATE);
+    }
+
+    sort_batch(columns.data());
+    timer.lap(stats::SORT);
+
+    for (size_t lane = 0; lane < width; ++lane) {
+      solution.clear();
+      for (size_t i = 0; i < list.size(); ++i) {
+        solution.append_decimal(
+            sorting_network::encode<Order>(columns[i * width + lane]));
+      }
+      timer.lap(stats::SERIALIZE);
+      solution.digest(hash);
+      timer.lap(stats::HASH);
+
+      const bool solved = matches_prefix(hash);
+      timer.lap(stats::CHECK);
+      timer.attempt();
+      if (solved && solutions.offer(epoch, batch_nonces[lane])) {
+        trace::instant("solution", "nonce", batch_nonces[lane]);
+      }
+      seeds.commit();
     }
+  }
+}
+
+// With Elements fixed at compile time the list is held inline in the
+// worker_local buffers, on the heap, and n_elements has to be Elements.  Lists
+// short enough are sorted in batches by the sort_network kernel unless it's
+// off.
+template <SortOrder Order, size_t Elements = DYNAMIC_EXTENT, typename Matcher>
+void solve_sorted_list(const SeedHasher& seed_hasher,
+                       const Matcher& matches_prefix, const int n_elements,
+                       const CancellationToken& stopped,
+                       SolutionSlot& solutions, const uint64_t epoch,
+                       NonceCursor& nonces) {
+  const size_t width = sorting_network::kernel().get();
+  const auto sort_batch = sorting_network::sort_batch<Elements>(width);
+  if (sort_batch != nullptr) {
+    solve_sorted_list_batched<Order, Elements>(
+        seed_hasher, matches_prefix, n_elements, width, sort_batch, stopped,
+        solutions, epoch, nonces);
+    return;
+  }
 
-    std::sort(list.begin(), list.end(), cmp);
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  SeedBatch seeds(seed_hasher, nonces);
+  uint64_t last_nonce;
+  uint64_t seed;
+
+  MersenneTwister64 rng;
+  const bool radix = sort_kernel().get() == SortAlgorithm::RADIX;
+
+  // Kept per worker thread so its scratch space survives across challenges.
+  auto& list = worker_local<ExtentArray<uint64_t, Elements>>(n_elements);
+  static thread_local RadixSorter<Order> sorter;
+  static thread_local serialize::SolutionBuffer solution;
+  solution.reserve(list.size() * serialize::MAX_DECIMAL_DIGITS);
 
-    SHA256_CTX solution_ctx;
-    SHA256_Init(&solution_ctx);
+  trace::AttemptTimer timer;
+  while (!stopped) {
+    seeds.next(last_nonce, seed);
+    timer.lap(stats::SEED);
+    rng.seed(seed);
+    rng.generate(list.data(), list.size());
+    timer.lap(stats::GENERATE);
 
-    // Generate the solution hash on the fly to avoid continual string
-    // concatenation.
-    for (int i = 0; i < n_elements; ++i) {
-      custom_to_string(list[i], buffer);
-      SHA256_Update(&solution_ctx, buffer.data(), buffer.size());
+    if (radix) {
+      sorter.sort(list.data(), list.size());
+    } else {
+      RadixSorter<Order>::comparison_sort(list.data(), list.size());
     }
+    timer.lap(stats::SORT);
 
-    SHA256_Final(hash, &solution_ctx);
+    solution.clear();
+    for (const auto i : list) solution.append_decimal(i);
+    timer.lap(stats::SERIALIZE);
+    solution.digest(hash);
+    timer.lap(stats::HASH);
 
-    buffer.clear();
-    for (unsigned i = 0; i < hash_prefix.length(); ++i) {
-      if ((i & 1ul) == 0ul) {
-        buffer.push_back(TO_HEX_CHAR(hash[i / 2] >> 4));
-      } else {
-        buffer.push_back(TO_HEX_CHAR(hash[i / 2] & 0x0F));
+    const bool solved = matches_prefix(hash);
+    timer.lap(stats::CHECK);
+    timer.attempt();
+    // Keeps going until the challenge is replaced, for more candidates to
+    // fall back on if this one is rejected.
+    if (solved && solutions.offer(epoch, last_nonce)) {
+      trace::instant("solution", "nonce", last_nonce);
+    }
+    seeds.commit();
+  }
+}
+
+// Bytes an attempt touches per element of the list: the list itself, the
+// scatter and sort scratch, and its decimal text.
+constexpr size_t ATTEMPT_BYTES_PER_ELEMENT =
+    3 * sizeof(uint64_t) + serialize::MAX_DECIMAL_DIGITS;
+
+// What a worker's share of an attempt should fit in: about a core's L2.
+constexpr size_t ATTEMPT_BYTES_PER_WORKER = size_t(1) << 20;
+
+constexpr unsigned MAX_SORTED_LIST_GROUP = 64;
+
+// How many workers share each attempt on lists of `n_elements`: enough for
+// every share to fit in ATTEMPT_BYTES_PER_WORKER, as long as there are
+// workers, and 1 for lists that fit already.
+inline unsigned sorted_list_group_size(const size_t n_elements,
+                                       const unsigned n_workers) {
+  const size_t bytes = n_elements * ATTEMPT_BYTES_PER_ELEMENT;
+  const size_t needed =
+      (bytes + ATTEMPT_BYTES_PER_WORKER - 1) / ATTEMPT_BYTES_PER_WORKER;
+  return std::max<size_t>(
+      1, std::min<size_t>({needed, n_workers, MAX_SORTED_LIST_GROUP}));
+}
+
+// The workers sharing the attempts on one list.  The leader, rank 0, draws
+// every list.  Then every member scatters its slice of the list into buckets
+// by the top bits of the keys, sorts its run of buckets and writes them out
+// in decimal, and the leader hashes the pieces in order.  The buckets are in
+// sort order, so the text is exactly the one list's.
+//
+// Everything the members share lives here rather than in one of them, since
+// a member may leave for the next challenge while the others still finish
+// an attempt.
+class SortedListGroup {
+ public:
+  SortedListGroup(const unsigned size, const size_t n_elements)
+      : barrier_(size),
+        n_(n_elements),
+        bucket_bits_(bucket_bits(size)),
+        counts_(size << bucket_bits_),
+        starts_(buckets() + 1),
+        parts_(size) {}
+  SortedListGroup(const SortedListGroup&) = delete;
+  SortedListGroup& operator=(const SortedListGroup&) = delete;
+
+  unsigned size() const { return barrier_.size(); }
+  size_t n_elements() const { return n_; }
+
+  // False once `stopped`, for everyone to return.
+  bool wait(const CancellationToken& stopped) {
+    return barrier_.wait(stopped);
+  }
+
+  // Every key of a bucket shares this many top bits.
+  int common_bits() const { return bucket_bits_; }
+
+  // For the leader to draw the list into.  Allocated on its first call, so
+  // it's first touched on the leader's NUMA node.
+  uint64_t* list() {
+    if (list_.empty()) {
+      list_.resize(n_);
+      scattered_.resize(n_);
+    }
+    return list_.data();
+  }
+
+  serialize::SolutionBuffer& part(const unsigned rank) {
+    return parts_[rank];
+  }
+
+  // Step 1: how many keys of its slice go to each bucket.
+  template <SortOrder Order>
+  void count(const unsigned rank) {
+    uint64_t* counts = &counts_[rank << bucket_bits_];
+    std::fill(counts, counts + buckets(), 0);
+    for (size_t i = begin(rank); i < end(rank); ++i) {
+      ++counts[bucket<Order>(list_[i])];
+    }
+  }
+
+  // Step 2: moves its slice into the buckets.  Every member has its own
+  // part of each bucket, so none of them write the same place.
+  template <SortOrder Order>
+  void scatter(const unsigned rank) {
+    size_t next[size_t(1) << MAX_BUCKET_BITS];
+    size_t start = 0;
+    for (size_t b = 0; b < buckets(); ++b) {
+      if (rank == 0) starts_[b] = start;
+      for (unsigned member = 0; member < size(); ++member) {
+        if (member == rank) next[b] = start;
+        start += counts_[(member << bucket_bits_) + b];
       }
     }
+    if (rank == 0) starts_[buckets()] = start;
+    for (size_t i = begin(rank); i < end(rank); ++i) {
+      const uint64_t key = list_[i];
+      scattered_[next[bucket<Order>(key)]++] = key;
+    }
+  }
+
+  // Step 3: the buckets a member sorts, [first, last).  Only valid after
+  // the wait() that follows scatter().
+  size_t first_bucket(const unsigned rank) const {
+    return buckets() * rank / size();
+  }
+  size_t last_bucket(const unsigned rank) const {
+    return buckets() * (rank + 1) / size();
+  }
+  uint64_t* bucket_data(const size_t b) {
+    return scattered_.data() + starts_[b];
+  }
+  size_t bucket_size(const size_t b) const {
+    return starts_[b + 1] - starts_[b];
+  }
+
+  // Step 4, for the leader: the hash of every member's text in order.
+  void digest(unsigned char hash[SHA256_DIGEST_LENGTH]) const {
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    for (const auto& part : parts_) {
+      SHA256_Update(&ctx, part.data(), part.size());
+    }
+    SHA256_Final(hash, &ctx);
+  }
+
+ private:
+  static constexpr int MAX_BUCKET_BITS = 9;
+
+  GroupBarrier barrier_;
+  const size_t n_;
+  const int bucket_bits_;
+  std::vector<uint64_t> counts_;
+  std::vector<size_t> starts_;
+  std::vector<serialize::SolutionBuffer> parts_;
+  SortKeys list_;
+  SortKeys scattered_;
+
+  // About 8 buckets per member, so the runs they sort come out about even.
+  static int bucket_bits(const unsigned size) {
+    int bits = 3;
+    while (bits < MAX_BUCKET_BITS && (1u << bits) < 8 * size) ++bits;
+    return bits;
+  }
+
+  size_t buckets() const { return size_t(1) << bucket_bits_; }
+  size_t begin(const unsigned rank) const { return n_ * rank / size(); }
+  size_t end(const unsigned rank) const { return n_ * (rank + 1) / size(); }
+
+  template <SortOrder Order>
+  size_t bucket(const uint64_t key) const {
+    const uint64_t ordered = Order == SortOrder::ASCENDING ? key : ~key;
+    return ordered >> (64 - bucket_bits_);
+  }
+};
+
+// solve_sorted_list for the member `rank` of `group`.  Only the leader
+// takes nonces, times the attempt and offers solutions.
+template <SortOrder Order, typename Matcher>
+void solve_sorted_list_grouped(const SeedHasher& seed_hasher,
+                               const Matcher& matches_prefix,
+                               SortedListGroup& group, const unsigned rank,
+                               const CancellationToken& stopped,
+                               SolutionSlot& solutions, const uint64_t epoch,
+                               NonceCursor& nonces) {
+  const bool leader = rank == 0;
+  const bool radix = sort_kernel().get() == SortAlgorithm::RADIX;
+  static thread_local RadixSorter<Order> sorter;
+  serialize::SolutionBuffer& part = group.part(rank);
+
+  unsigned char hash[SHA256_DIGEST_LENGTH];
+  SeedBatch seeds(seed_hasher, nonces);
+  // Only the leader's are used.
+  uint64_t last_nonce = 0;
+  uint64_t seed = 0;
+  MersenneTwister64 rng;
+
+  trace::AttemptTimer timer;
+  while (!stopped) {
+    if (leader) {
+      seeds.next(last_nonce, seed);
+      timer.lap(stats::SEED);
+      rng.seed(seed);
+      rng.generate(group.list(), group.n_elements());
+      timer.lap(stats::GENERATE);
+    }
+    if (!group.wait(stopped)) return;
+    group.count<Order>(rank);
+    if (!group.wait(stopped)) return;
+    group.scatter<Order>(rank);
+    if (!group.wait(stopped)) return;
 
-    if (buffer == hash_prefix) {
-      nonce.hold();
-      nonce.set(last_nonce);
-      nonce.drop();
-      break;
+    const size_t first = group.first_bucket(rank);
+    const size_t last = group.last_bucket(rank);
+    for (size_t b = first; b < last; ++b) {
+      if (radix) {
+        sorter.sort(group.bucket_data(b), group.bucket_size(b),
+                    group.common_bits());
+      } else {
+        RadixSorter<Order>::comparison_sort(group.bucket_data(b),
+                                            group.bucket_size(b));
+      }
     }
+    if (leader) timer.lap(stats::SORT);
+
+    // The run of buckets is contiguous.
+    const uint64_t* run = group.bucket_data(first);
+    const size_t size = group.bucket_data(last) - run;
+    part.reserve(size * serialize::MAX_DECIMAL_DIGITS);
+    part.clear();
+    for (size_t i = 0; i < size; ++i) part.append_decimal(run[i]);
+    if (!group.wait(stopped)) return;
+    if (!leader) continue;
+    timer.lap(stats::SERIALIZE);
 
-    // Generate the new seed.
-    last_nonce = rng();
-    const auto new_seed =
-        generate_seed(last_nonce, last_solution_hash, buffer, hash);
-    rng.seed(new_seed);
+    group.digest(hash);
+    timer.lap(stats::HASH);
+    const bool solved = matches_prefix(hash);
+    timer.lap(stats::CHECK);
+    timer.attempt();
+    if (solved && solutions.offer(epoch, last_nonce)) {
+      trace::instant("solution", "nonce", last_nonce);
+    }
+    seeds.commit();
   }
 }
 
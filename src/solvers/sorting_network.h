@@ -0,0 +1,181 @@
+#ifndef __DANGMINER_SORTING_NETWORK__
+#define __DANGMINER_SORTING_NETWORK__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_dispatch.h"
+#include "extent.h"
+#include "radix_sort.h"
+
+// Sorts several short lists at once with a sorting network: the same fixed
+// sequence of compare-exchanges, whatever the keys, so it has no branches to
+// mispredict and runs one list per 64 bit SIMD lane.  The lists are stored
+// transposed, element i of every lane next to each other, and every
+// compare-exchange is a vector min and max.
+//
+// The network is Batcher's odd-even merge sort, built at compile time for
+// the list length, so only solvers specialized for a length (see
+// solver_registry.h) get one.  Unrolling it takes the compiler minutes for
+// no gain once the lists outgrow the registers, so it's a loop over a table.
+namespace sorting_network {
+
+// Longer lists need too many compare-exchanges to beat RadixSorter.
+constexpr size_t MAX_ELEMENTS = 256;
+
+// Lists per batch of the widest kernel.
+constexpr size_t MAX_WIDTH = 8;
+
+namespace detail {
+
+// Calls f(i, j) for every compare-exchange of the network sorting n
+// elements, in order.  Batcher's odd-even merge sort, with the comparators
+// past n left out, which still sorts.
+template <typename F>
+constexpr void for_each_comparator(const size_t n, F&& f) {
+  for (size_t p = 1; p < n; p *= 2) {
+    for (size_t k = p; k >= 1; k /= 2) {
+      for (size_t j = k % p; j + k < n; j += 2 * k) {
+        for (size_t i = 0; i < k && i + j + k < n; ++i) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) f(i + j, i + j + k);
+        }
+      }
+    }
+  }
+}
+
+struct Counter {
+  size_t count;
+  constexpr void operator()(size_t, size_t) { ++count; }
+};
+
+constexpr size_t count_comparators(const size_t n) {
+  Counter counter{0};
+  for_each_comparator(n, counter);
+  return counter.count;
+}
+
+template <size_t N>
+struct Comparators {
+  static constexpr size_t SIZE = count_comparators(N);
+  uint16_t first[SIZE];
+  uint16_t second[SIZE];
+};
+
+template <size_t N>
+struct Recorder {
+  Comparators<N>& comparators;
+  size_t next;
+  constexpr void operator()(const size_t i, const size_t j) {
+    comparators.first[next] = i;
+    comparators.second[next] = j;
+    ++next;
+  }
+};
+
+template <size_t N>
+constexpr Comparators<N> make_comparators() {
+  Comparators<N> comparators{};
+  Recorder<N> recorder{comparators, 0};
+  for_each_comparator(N, recorder);
+  return comparators;
+}
+
+template <size_t N>
+struct Network {
+  static constexpr Comparators<N> COMPARATORS = make_comparators<N>();
+};
+
+template <size_t N>
+constexpr Comparators<N> Network<N>::COMPARATORS;
+
+// Width 64 bit lanes, compiled for whichever kernel below they're inlined
+// into, as in multibuffer_sha256.h.  Signed, since AVX2 only compares
+// signed 64 bit integers.
+template <size_t Width>
+struct Lanes {
+  typedef int64_t V __attribute__((vector_size(Width * 8)));
+};
+
+// Sorts the Width lists of N encoded keys in `columns`, key i of lane l at
+// columns[i * Width + l].
+template <size_t N, size_t Width>
+ALWAYS_INLINE void sort_columns(uint64_t* columns) {
+  using V = typename Lanes<Width>::V;
+  const auto& network = Network<N>::COMPARATORS;
+  for (size_t c = 0; c < network.SIZE; ++c) {
+    uint64_t* a_at = columns + network.first[c] * Width;
+    uint64_t* b_at = columns + network.second[c] * Width;
+    V a;
+    V b;
+    std::memcpy(&a, a_at, sizeof(V));
+    std::memcpy(&b, b_at, sizeof(V));
+    const auto a_first = a < b;
+    const V low = a_first ? a : b;
+    const V high = a_first ? b : a;
+    std::memcpy(a_at, &low, sizeof(V));
+    std::memcpy(b_at, &high, sizeof(V));
+  }
+}
+
+}  // namespace detail
+
+// Lanes per batch of the selected kernel, 0 if batches aren't sorted by
+// networks at all.
+inline cpu_dispatch::Kernel<size_t>& kernel() {
+  static cpu_dispatch::Kernel<size_t> kernel("sort_network", {
+#if defined(DANGMINER_X86_DISPATCH)
+    {"avx512", 8, cpu_dispatch::has_avx512()},
+    {"avx2", 4, cpu_dispatch::has_avx2()},
+#endif
+    {"off", 0, true},
+  });
+  return kernel;
+}
+
+// What the batches hold instead of a key: sorting those as signed integers
+// in ascending order sorts the keys in `Order`.  Its own inverse.
+template <SortOrder Order>
+inline uint64_t encode(const uint64_t key) {
+  constexpr uint64_t SIGN = uint64_t(1) << 63;
+  return key ^ (Order == SortOrder::ASCENDING ? SIGN : ~SIGN);
+}
+
+// Sorts a batch of Width lists of N encoded keys, laid out as in
+// detail::sort_columns.
+using SortBatch = void (*)(uint64_t* columns);
+
+#if defined(DANGMINER_X86_DISPATCH)
+
+template <size_t N>
+TARGET_AVX512 void sort_batch_avx512(uint64_t* columns) {
+  detail::sort_columns<N, 8>(columns);
+}
+
+template <size_t N>
+TARGET_AVX2 void sort_batch_avx2(uint64_t* columns) {
+  detail::sort_columns<N, 4>(columns);
+}
+
+#endif
+
+// The batch sort for lists of N keys of the kernel `width` lanes wide, or
+// null if that's "off", or N isn't known at compile time or is over
+// MAX_ELEMENTS.
+template <size_t N>
+SortBatch sort_batch(const size_t width) {
+  constexpr bool fits = N != DYNAMIC_EXTENT && N <= MAX_ELEMENTS;
+  if (!fits) return nullptr;
+#if defined(DANGMINER_X86_DISPATCH)
+  // Some length the network can be built for, when N can't.
+  constexpr size_t n = fits ? N : 2;
+  if (width == 8) return sort_batch_avx512<n>;
+  if (width == 4) return sort_batch_avx2<n>;
+#endif
+  return nullptr;
+}
+
+}  // namespace sorting_network
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef __DANGMINER_WAVEFRONT_PATH__
+#define __DANGMINER_WAVEFRONT_PATH__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "extent.h"
+#include "grid_state.h"
+
+// Breadth first search over a bitboard grid.  Every row is a run of 64 bit
+// words with bit `col` set when (row, col) is passable, and a whole BFS layer
+// is produced at once by shifting the previous layer up, down, left and right
+// and masking out walls and visited cells.
+//
+// Only the distance of each reached cell is recorded.  The path is rebuilt
+// backwards from the end, choosing at every step the neighbor one layer closer
+// that comes first in (row, col) order.  That is exactly the cell the
+// Dijkstra search in shortest_path.h pops first out of its (priority, row,
+// col) heap, and so the one that becomes came_from, which makes the two
+// engines produce identical paths.
+//
+// With a GridSize fixed at compile time every buffer is held inline and the
+// loops over words and rows have constant bounds; WavefrontPathFinder takes
+// the size at run time.
+template <size_t GridSize>
+class BasicWavefrontPathFinder {
+ public:
+  static constexpr size_t EXTENT = GridSize;
+
+  explicit BasicWavefrontPathFinder(const int grid_size)
+      : size_(GridSize == DYNAMIC_EXTENT ? grid_size : GridSize),
+        words_((size_ + 63) / 64),
+        passable_(size_ * words_),
+        visited_(size_ * words_),
+        interior_row_(words_),
+        distance_(size_ * size_),
+        layers_{Board(size_ * words_), Board(size_ * words_)} {
+    std::fill(interior_row_.begin(), interior_row_.end(), 0);
+    std::fill(layers_[0].begin(), layers_[0].end(), 0);
+    std::fill(layers_[1].begin(), layers_[1].end(), 0);
+    for (size_t col = 1; col + 1 < size(); ++col) {
+      interior_row_[col / 64] |= uint64_t(1) << (col % 64);
+    }
+  }
+
+  // Blocks the outer ring and opens everything else.
+  void reset() {
+    std::fill(passable_.begin(), passable_.begin() + words(), 0);
+    for (size_t row = 1; row + 1 < size(); ++row) {
+      std::copy(interior_row_.begin(), interior_row_.end(),
+                passable_.begin() + row * words());
+    }
+    std::fill(passable_.end() - words(), passable_.end(), 0);
+  }
+
+  bool passable(const uint64_t row, const uint64_t col) const {
+    return (passable_[row * words() + col / 64] >> (col % 64)) & 1;
+  }
+
+  void block(const uint64_t row, const uint64_t col) {
+    passable_[row * words() + col / 64] &= ~(uint64_t(1) << (col % 64));
+  }
+
+  // Fills `path` with the shortest path from start to end, both included.
+  // Returns false if end can't be reached or the search was stopped.
+  bool find_path(const State& start, const State& end,
+                 const CancellationToken& stopped, std::vector<State>& path) {
+    path.clear();
+    std::fill(visited_.begin(), visited_.end(), 0);
+    clear_layer(0);
+    clear_layer(1);
+
+    set_bit(visited_, start.row, start.col);
+    set_bit(layers_[0], start.row, start.col);
+    distance_[start.row * size() + start.col] = 0;
+    lo_[0] = hi_[0] = start.row;
+
+    uint32_t end_distance = 0;
+    int current = 0;
+    for (uint32_t d = 1; !test_bit(visited_, end.row, end.col); ++d) {
+      if (stopped) return false;
+      if (!expand(current, d)) return false;
+      current ^= 1;
+      end_distance = d;
+    }
+
+    path.resize(end_distance + 1);
+    uint64_t row = end.row;
+    uint64_t col = end.col;
+    path[end_distance] = State{row, col, end_distance};
+    for (uint32_t d = end_distance; d > 0; --d) {
+      // Neighbors in (row, col) order.
+      if (reached_at(row - 1, col, d - 1)) {
+        --row;
+      } else if (reached_at(row, col - 1, d - 1)) {
+        --col;
+      } else if (reached_at(row, col + 1, d - 1)) {
+        ++col;
+      } else {
+        ++row;
+      }
+      path[d - 1] = State{row, col, d - 1};
+    }
+    return true;
+  }
+
+ private:
+  // Words per row, DYNAMIC_EXTENT when GridSize is.
+  static constexpr size_t WORDS = (GridSize + 63) / 64;
+  using Board = ExtentArray<uint64_t, scale_extent(GridSize, WORDS)>;
+
+  // Only read through size() and words(), which are constants when GridSize
+  // is fixed.
+  const size_t size_;
+  const size_t words_;
+
+  Board passable_;
+  Board visited_;
+  ExtentArray<uint64_t, WORDS> interior_row_;
+  ExtentArray<uint32_t, scale_extent(GridSize, GridSize)> distance_;
+
+  // The current and next BFS layers.  A layer is all zero outside its rows
+  // [lo_, hi_], which is what lets expand() skip most of the grid.
+  Board layers_[2];
+  size_t lo_[2] = {EMPTY_LO, EMPTY_LO};
+  size_t hi_[2] = {0, 0};
+
+  // lo_ of a layer with no rows in it.
+  static constexpr size_t EMPTY_LO = ~size_t(0);
+
+  size_t size() const { return GridSize == DYNAMIC_EXTENT ? size_ : GridSize; }
+  size_t words() const { return GridSize == DYNAMIC_EXTENT ? words_ : WORDS; }
+
+  void set_bit(Board& board, const uint64_t row, const uint64_t col) {
+    board[row * words() + col / 64] |= uint64_t(1) << (col % 64);
+  }
+
+  bool test_bit(const Board& board, const uint64_t row,
+                const uint64_t col) const {
+    return (board[row * words() + col / 64] >> (col % 64)) & 1;
+  }
+
+  bool reached_at(const uint64_t row, const uint64_t col,
+                  const uint32_t d) const {
+    return test_bit(visited_, row, col) && distance_[row * size() + col] == d;
+  }
+
+  void clear_layer(const int layer) {
+    if (lo_[layer] <= hi_[layer]) {
+      std::fill(layers_[layer].begin() + lo_[layer] * words(),
+                layers_[layer].begin() + (hi_[layer] + 1) * words(), 0);
+    }
+    lo_[layer] = EMPTY_LO;
+    hi_[layer] = 0;
+  }
+
+  // Writes layer d into layers_[current ^ 1] from layer d - 1 in
+  // layers_[current].  Returns false if the new layer is empty.
+  bool expand(const int current, const uint32_t d) {
+    const int next = current ^ 1;
+    clear_layer(next);
+
+    // The outer ring is never passable, so rows 0 and size() - 1 can't be
+    // reached and never need their neighbors looked at.
+    const size_t first = std::max<size_t>(lo_[current], 2) - 1;
+    const size_t last = std::min(hi_[current] + 1, size() - 2);
+
+    const uint64_t* from = layers_[current].data();
+    uint64_t* to = layers_[next].data();
+    for (size_t row = first; row <= last; ++row) {
+      const uint64_t* above = from + (row - 1) * words();
+      const uint64_t* here = from + row * words();
+      const uint64_t* below = from + (row + 1) * words();
+      const uint64_t* open = passable_.data() + row * words();
+      uint64_t* seen = visited_.data() + row * words();
+      uint64_t* out = to + row * words();
+
+      uint64_t any = 0;
+      for (size_t w = 0; w < words(); ++w) {
+        const uint64_t from_left =
+            (here[w] << 1) | (w > 0 ? here[w - 1] >> 63 : 0);
+        const uint64_t from_right =
+            (here[w] >> 1) | (w + 1 < words() ? here[w + 1] << 63 : 0);
+        const uint64_t reached =
+            (above[w] | below[w] | from_left | from_right) & open[w] & ~seen[w];
+        out[w] = reached;
+        seen[w] |= reached;
+        any |= reached;
+      }
+      if (any == 0) continue;
+
+      lo_[next] = std::min(lo_[next], row);
+      hi_[next] = row;
+      uint32_t* row_distance = distance_.data() + row * size();
+      for (size_t w = 0; w < words(); ++w) {
+        for (uint64_t bits = out[w]; bits != 0; bits &= bits - 1) {
+          row_distance[w * 64 + __builtin_ctzll(bits)] = d;
+        }
+      }
+    }
+    return lo_[next] <= hi_[next];
+  }
+};
+
+using WavefrontPathFinder = BasicWavefrontPathFinder<DYNAMIC_EXTENT>;
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __DANGMINER_WORKER_LOCAL__
+#define __DANGMINER_WORKER_LOCAL__
+
+#include <memory>
+
+// The calling worker thread's T built from `key` (a list length, a grid
+// size), kept from one challenge to the next and only rebuilt when the key
+// changes, so switching challenges doesn't allocate.  Built by the worker
+// itself, so its memory is first touched on the worker's NUMA node.
+//
+// There's one per thread and type, so a solver must not hold on to it across
+// a call to another solver using the same type.
+template <typename T, typename Key>
+T& worker_local(const Key& key) {
+  struct Cached {
+    std::unique_ptr<T> value;
+    Key key;
+  };
+  static thread_local Cached cached;
+  if (!cached.value || !(cached.key == key)) {
+    cached.value.reset();
+    cached.value.reset(new T(key));
+    cached.key = key;
+  }
+  return *cached.value;
+}
+
+#endif